@@ -0,0 +1,171 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Bank-mode input path: raw MIDI dispatched to libADLMIDI's real-time API
+// (adl_rt_dispatch), with the chip's register writes going through
+// OPL3State (RetroWaveADLChip) into a null sink. Reports the same columns as
+// retrowave_bench plus the writes removed by elision and coalescing;
+// --no-elide turns both off to show the unfiltered traffic.
+//
+// Each workload also runs through the previous dispatch, the MIDI
+// sequencer's parseEvent/handleEvent ("seq" rows), for comparison.
+//
+// Usage: retrowave_bench_bank [--events N] [--batch N] [--bank ID] [--no-elide] [--rt-only]
+//   --rt-only    skip the sequencer rows
+
+#include <retrowave/adl_chip.h>
+#include <retrowave/adl_realtime.h>
+#include <retrowave/opl3_hw.h>
+#include <retrowave/opl3_state.h>
+
+#include <adlmidi.h>
+#include <adlmidi_midiplay.hpp>
+#include <adlmidi_opl3.hpp>
+#include <midi_sequencer.hpp>
+
+#include <chrono>
+#include <cstdlib>
+
+#include "bench_common.h"
+
+using namespace retrowave;
+using namespace bench;
+
+struct Workload {
+	const char *name;
+	std::vector<Event> (*make)(size_t, std::mt19937 &);
+};
+
+// Real-time API (the daemon and GUI), or the MIDI sequencer they used before
+enum class Dispatch { Realtime, Sequencer };
+
+static bool run(const Workload &w, Dispatch dispatch, size_t n, size_t batch, int bank,
+                bool elide)
+{
+	using clock = std::chrono::steady_clock;
+
+	std::mt19937 rng(1234);
+	std::vector<Event> events = w.make(n, rng);
+
+	NullSerialPort port;
+	OPL3HardwareBuffer hw(port);
+	OPL3State state(hw);
+	hw.set_coalescing(elide);
+	state.set_write_elision(elide);
+
+	ADL_MIDIPlayer *player = adl_init(1000);
+	if (!player)
+		return false;
+	adl_setNumChips(player, 1);
+	if (adl_setBank(player, bank)) {
+		fprintf(stderr, "failed to set bank %d: %s\n", bank, adl_errorInfo(player));
+		adl_close(player);
+		return false;
+	}
+
+	auto *midiplay = static_cast<MIDIplay *>(player->adl_midiPlayer);
+	auto *synth = midiplay->m_synth.get();
+	synth->m_chips[0].reset(new RetroWaveADLChip(state));
+	synth->updateChannelCategories();
+	synth->silenceAll();
+	hw.flush();
+
+	MidiSequencer *seq = midiplay->m_sequencer.get();
+	for (unsigned i = 0; i < 16; i++)
+		seq->setChannelEnabled(i, true);
+	seq->m_trackDisable.resize(16);
+
+	uint64_t bytes0 = port.bytes, writes0 = port.writes;
+	uint64_t elided0 = state.elided_writes(), coalesced0 = hw.coalesced_writes();
+
+	std::vector<uint32_t> ns(events.size());
+	auto start = clock::now();
+	for (size_t i = 0; i < events.size(); ++i) {
+		const Event &e = events[i];
+		auto t0 = clock::now();
+		if (dispatch == Dispatch::Realtime) {
+			adl_rt_dispatch(player, e.data(), e.size());
+		} else {
+			const uint8_t *pp = e.data();
+			int status = 0;
+			auto evt = seq->parseEvent(&pp, pp + e.size(), status);
+			int32_t handled = 0;
+			seq->handleEvent(0, evt, handled);
+		}
+		if ((i + 1) % batch == 0)
+			hw.flush();
+		ns[i] = static_cast<uint32_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count());
+	}
+	hw.flush();
+	double secs = std::chrono::duration<double>(clock::now() - start).count();
+
+	print_row(w.name, dispatch == Dispatch::Realtime ? "rt" : "seq", ns, secs, port.writes - writes0, port.bytes - bytes0);
+	printf("%-12s %-6s elided %llu, coalesced %llu\n", "", "",
+	       (unsigned long long)(state.elided_writes() - elided0),
+	       (unsigned long long)(hw.coalesced_writes() - coalesced0));
+
+	adl_close(player);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	size_t events = 100000;
+	size_t batch = 1;
+	int bank = 58;
+	bool elide = true;
+	bool rt_only = false;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--events" && i + 1 < argc) {
+			events = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--batch" && i + 1 < argc) {
+			batch = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+		} else if (arg == "--bank" && i + 1 < argc) {
+			bank = std::atoi(argv[++i]);
+		} else if (arg == "--no-elide") {
+			elide = false;
+		} else if (arg == "--rt-only") {
+			rt_only = true;
+		} else {
+			fprintf(stderr, "Usage: %s [--events N] [--batch N] [--bank ID] [--no-elide] [--rt-only]\n",
+			        argv[0]);
+			return 1;
+		}
+	}
+
+	static const Workload kWorkloads[] = {
+		{"note-storm", make_note_storm},
+		{"cc-flood", make_cc_flood},
+		{"bend-sweep", make_bend_sweep},
+		{"program", make_program_changes},
+	};
+
+	printf("%zu events per workload, flush every %zu, bank %d, elision %s, null sink\n\n",
+	       events, batch, bank, elide ? "on" : "off");
+	print_header();
+
+	for (const auto &w : kWorkloads) {
+		if (!run(w, Dispatch::Realtime, events, batch, bank, elide))
+			return 1;
+		if (!rt_only && !run(w, Dispatch::Sequencer, events, batch, bank, elide))
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,235 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Shared pieces of the benchmark tools: synthetic MIDI workloads, a
+// counting serial sink and the result table.
+
+#pragma once
+
+#include <retrowave/direct_mode.h>
+#include <retrowave/serial_port.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+using retrowave::SerialPort;
+
+using Event = std::vector<uint8_t>;
+
+// --- Sinks ---
+
+// Counts bytes and register writes without decoding anything.
+class NullSerialPort : public SerialPort {
+public:
+	bool open(const std::string &) override { return true; }
+	void close() override {}
+	bool is_open() const override { return true; }
+
+	bool write(const uint8_t *, size_t len) override
+	{
+		if (len < 2)
+			return true;
+		// Invert the 7-bit packing: n packed bytes carry n - ceil(n/8) raw
+		// bytes, of which 2 are the header and 6 per register write.
+		size_t packed = len - 2;
+		size_t raw = packed - (packed + 7) / 8;
+		bytes += len;
+		writes += raw >= 2 ? (raw - 2) / 6 : 0;
+		return true;
+	}
+
+	uint64_t bytes = 0;
+	uint64_t writes = 0;
+};
+
+// --- Workloads ---
+
+inline Event note_on(uint8_t ch, uint8_t note, uint8_t vel)
+{
+	return {static_cast<uint8_t>(0x90 | ch), note, vel};
+}
+
+inline Event note_off(uint8_t ch, uint8_t note)
+{
+	return {static_cast<uint8_t>(0x80 | ch), note, 0};
+}
+
+inline Event cc(uint8_t ch, uint8_t num, uint8_t val)
+{
+	return {static_cast<uint8_t>(0xB0 | ch), num, val};
+}
+
+inline Event bend(uint8_t ch, uint16_t val)
+{
+	return {static_cast<uint8_t>(0xE0 | ch), static_cast<uint8_t>(val & 0x7F),
+	        static_cast<uint8_t>((val >> 7) & 0x7F)};
+}
+
+// Random note on/off traffic on all 16 channels, up to 8 held per channel.
+inline std::vector<Event> make_note_storm(size_t n, std::mt19937 &rng)
+{
+	std::vector<Event> ev;
+	std::vector<std::vector<uint8_t>> held(16);
+	while (ev.size() < n) {
+		uint8_t ch = rng() % 16;
+		auto &h = held[ch];
+		if (!h.empty() && (h.size() >= 8 || rng() % 2)) {
+			size_t i = rng() % h.size();
+			ev.push_back(note_off(ch, h[i]));
+			h.erase(h.begin() + i);
+		} else {
+			uint8_t note = 24 + rng() % 84;
+			if (std::find(h.begin(), h.end(), note) != h.end())
+				continue;
+			ev.push_back(note_on(ch, note, 1 + rng() % 127));
+			h.push_back(note);
+		}
+	}
+	return ev;
+}
+
+// Dense chords on MIDI channel 0 only: up to 24 held notes, so any pool
+// smaller than that keeps stealing.
+inline std::vector<Event> make_chord_storm(size_t n, std::mt19937 &rng)
+{
+	std::vector<Event> ev;
+	std::vector<uint8_t> held;
+	while (ev.size() < n) {
+		if (!held.empty() && (held.size() >= 24 || rng() % 2)) {
+			size_t i = rng() % held.size();
+			ev.push_back(note_off(0, held[i]));
+			held.erase(held.begin() + i);
+		} else {
+			uint8_t note = 24 + rng() % 84;
+			if (std::find(held.begin(), held.end(), note) != held.end())
+				continue;
+			ev.push_back(note_on(0, note, 1 + rng() % 127));
+			held.push_back(note);
+		}
+	}
+	return ev;
+}
+
+// Volume/pan/expression/mod/brightness on all 16 channels with notes held.
+inline std::vector<Event> make_cc_flood(size_t n, std::mt19937 &rng)
+{
+	static const uint8_t kCCs[] = {1, 7, 10, 11, 74};
+	std::vector<Event> ev;
+	for (uint8_t ch = 0; ch < 16; ++ch)
+		ev.push_back(note_on(ch, 48 + ch, 100));
+	while (ev.size() < n)
+		ev.push_back(cc(rng() % 16, kCCs[rng() % 5], rng() % 128));
+	return ev;
+}
+
+// One held note, bend swept end to end and back.
+inline std::vector<Event> make_bend_sweep(size_t n, std::mt19937 &)
+{
+	std::vector<Event> ev;
+	ev.push_back(note_on(0, 60, 100));
+	int v = 0, step = 64;
+	while (ev.size() < n) {
+		ev.push_back(bend(0, static_cast<uint16_t>(v)));
+		v += step;
+		if (v > 16383 || v < 0) {
+			step = -step;
+			v += 2 * step;
+		}
+	}
+	return ev;
+}
+
+// 8-bit batch writes of 32 operator registers across both ports.
+inline std::vector<Event> make_sysex_batch(size_t n, std::mt19937 &rng)
+{
+	static const uint8_t kBanks[] = {0x20, 0x40, 0x60, 0x80, 0xE0};
+	std::vector<Event> ev;
+	while (ev.size() < n) {
+		Event e = {0xF0, 0x7D, 0x7F, retrowave::kSysExBatchWrite8, 32};
+		for (int i = 0; i < 32; ++i) {
+			uint16_t addr = static_cast<uint16_t>((rng() % 2 ? 0x100 : 0) |
+			                                      (kBanks[rng() % 5] + rng() % 0x16));
+			uint8_t val = static_cast<uint8_t>(rng());
+			e.push_back(static_cast<uint8_t>(addr >> 7));
+			e.push_back(static_cast<uint8_t>(addr & 0x7F));
+			e.push_back(val >> 4);
+			e.push_back(val & 0x0F);
+		}
+		e.push_back(0xF7);
+		ev.push_back(std::move(e));
+	}
+	return ev;
+}
+
+// 2-op patch loads onto random channels.
+inline std::vector<Event> make_patch_load(size_t n, std::mt19937 &rng)
+{
+	std::vector<Event> ev;
+	while (ev.size() < n) {
+		Event e = {0xF0, 0x7D, 0x7F, retrowave::kSysExPatchLoad,
+		           static_cast<uint8_t>(rng() % 18)};
+		for (int i = 0; i < 46; ++i)
+			e.push_back(rng() % 16);
+		e.push_back(0xF7);
+		ev.push_back(std::move(e));
+	}
+	return ev;
+}
+
+// Program changes interleaved with notes on all 16 channels.
+inline std::vector<Event> make_program_changes(size_t n, std::mt19937 &rng)
+{
+	std::vector<Event> ev;
+	while (ev.size() < n) {
+		uint8_t ch = rng() % 16;
+		uint8_t note = 36 + rng() % 60;
+		ev.push_back({static_cast<uint8_t>(0xC0 | ch), static_cast<uint8_t>(rng() % 128)});
+		ev.push_back(note_on(ch, note, 100));
+		ev.push_back(note_off(ch, note));
+	}
+	ev.resize(n);
+	return ev;
+}
+
+// --- Results ---
+
+inline void print_header()
+{
+	printf("%-12s %-6s %10s %9s %9s %7s %7s %7s %8s\n",
+	       "workload", "target", "events/s", "writes/ev", "bytes/ev",
+	       "p50 ns", "p90 ns", "p99 ns", "max ns");
+}
+
+// ns is sorted in place.
+inline void print_row(const char *workload, const char *target, std::vector<uint32_t> &ns,
+                      double secs, uint64_t writes, uint64_t bytes)
+{
+	std::sort(ns.begin(), ns.end());
+	auto pct = [&](double p) { return ns[static_cast<size_t>(p * (ns.size() - 1))]; };
+	double count = static_cast<double>(ns.size());
+	printf("%-12s %-6s %10.0f %9.2f %9.2f %7u %7u %7u %8u\n",
+	       workload, target, count / secs, writes / count, bytes / count,
+	       pct(0.50), pct(0.90), pct(0.99), ns.back());
+}
+
+} // namespace bench
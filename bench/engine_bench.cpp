@@ -0,0 +1,641 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Drives VoiceAllocator::process_midi and DirectMode::process_midi with
+// synthetic workloads and reports throughput, register writes and wire
+// bytes per event, and per-event latency percentiles.
+//
+// Usage: retrowave_bench [--events N] [--batch N] [--loopback] [--sweep] [--verify]
+//   --events N   events per workload (default 100000)
+//   --batch N    flush every N events (default 1: one frame per event)
+//   --loopback   decode every frame through LoopbackSerialPort and check
+//                the resulting register image against the shadow
+//   --sweep      instead, run a chord storm on one MIDI channel across
+//                VoiceAllocator pool sizes and unison counts
+//   --verify     instead, check allocator output against known-good hashes
+//                and DirectMode level tables and NRPN handling against
+//                reference implementations;
+//                exits non-zero on any mismatch
+
+#include <retrowave/direct_mode.h>
+#include <retrowave/opl3_hw.h>
+#include <retrowave/opl3_registers.h>
+#include <retrowave/opl3_state.h>
+#include <retrowave/serial_loopback.h>
+#include <retrowave/voice_allocator.h>
+
+#include "bench_common.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace retrowave;
+using namespace bench;
+
+// --- Engine under test ---
+
+enum class Target { Allocator, Direct };
+
+struct Engine {
+	NullSerialPort null_port;
+	LoopbackSerialPort loop_port;
+	SerialPort &port;
+	OPL3HardwareBuffer hw;
+	OPL3State state;
+	DirectMode dm;
+	VoiceAllocator alloc;
+
+	explicit Engine(bool loopback)
+		: port(loopback ? static_cast<SerialPort &>(loop_port) : null_port)
+		, hw(port)
+		, state(hw)
+		, dm(state)
+		, alloc(dm, state)
+	{
+		port.open("bench");
+		loop_port.set_logging(false);
+		state.reset();
+		dm.init();
+		alloc.init_default_mapping();
+		hw.flush();
+	}
+
+	void counts(uint64_t &bytes, uint64_t &writes) const
+	{
+		if (&port == &null_port) {
+			bytes = null_port.bytes;
+			writes = null_port.writes;
+		} else {
+			auto s = loop_port.stats();
+			bytes = s.bytes;
+			writes = s.writes;
+		}
+	}
+};
+
+struct Workload {
+	const char *name;
+	std::vector<Event> (*make)(size_t, std::mt19937 &);
+	bool unison; // give MIDI channel 0 six OPL3 channels in 6-voice unison
+	             // (VoiceAllocator only: DirectMode has no unison)
+};
+
+static bool run(const Workload &w, Target target, size_t n, size_t batch, bool loopback)
+{
+	using clock = std::chrono::steady_clock;
+
+	std::mt19937 rng(1234);
+	std::vector<Event> events = w.make(n, rng);
+
+	Engine eng(loopback);
+	if (w.unison) {
+		VoiceConfig vc;
+		vc.opl3_channels = {0, 1, 2, 3, 4, 5};
+		vc.unison_count = 6;
+		eng.alloc.set_voice_config(0, vc);
+		eng.hw.flush();
+	}
+
+	uint64_t bytes0, writes0;
+	eng.counts(bytes0, writes0);
+
+	std::vector<uint32_t> ns(events.size());
+	auto start = clock::now();
+	for (size_t i = 0; i < events.size(); ++i) {
+		const Event &e = events[i];
+		auto t0 = clock::now();
+		if (target == Target::Allocator)
+			eng.alloc.process_midi(e.data(), e.size());
+		else
+			eng.dm.process_midi(e.data(), e.size());
+		if ((i + 1) % batch == 0)
+			eng.hw.flush();
+		ns[i] = static_cast<uint32_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count());
+	}
+	eng.hw.flush();
+	double secs = std::chrono::duration<double>(clock::now() - start).count();
+
+	uint64_t bytes1, writes1;
+	eng.counts(bytes1, writes1);
+
+	print_row(w.name, target == Target::Allocator ? "alloc" : "direct", ns, secs,
+	          writes1 - writes0, bytes1 - bytes0);
+
+	if (loopback) {
+		auto image = eng.loop_port.registers();
+		for (uint16_t addr = 0; addr < 512; ++addr) {
+			if (image[addr] != eng.state.read(addr)) {
+				fprintf(stderr, "  register 0x%03X: card 0x%02X, shadow 0x%02X\n",
+				        addr, image[addr], eng.state.read(addr));
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Per-event cost of the allocator as the pool and unison count grow.
+static void run_sweep(size_t n, size_t batch)
+{
+	using clock = std::chrono::steady_clock;
+
+	static const int kPools[] = {2, 6, 12, 18};
+	static const int kUnison[] = {1, 2, 3, 6};
+
+	std::mt19937 rng(1234);
+	std::vector<Event> events = make_chord_storm(n, rng);
+
+	for (int pool : kPools) {
+		for (int unison : kUnison) {
+			if (unison > pool)
+				continue;
+
+			Engine eng(false);
+			VoiceConfig vc;
+			for (int ch = 0; ch < pool; ++ch)
+				vc.opl3_channels.push_back(static_cast<uint8_t>(ch));
+			vc.unison_count = static_cast<uint8_t>(unison);
+			eng.alloc.set_voice_config(0, vc);
+			eng.hw.flush();
+
+			uint64_t bytes0, writes0;
+			eng.counts(bytes0, writes0);
+
+			std::vector<uint32_t> ns(events.size());
+			auto start = clock::now();
+			for (size_t i = 0; i < events.size(); ++i) {
+				const Event &e = events[i];
+				auto t0 = clock::now();
+				eng.alloc.process_midi(e.data(), e.size());
+				if ((i + 1) % batch == 0)
+					eng.hw.flush();
+				ns[i] = static_cast<uint32_t>(
+					std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count());
+			}
+			eng.hw.flush();
+			double secs = std::chrono::duration<double>(clock::now() - start).count();
+
+			uint64_t bytes1, writes1;
+			eng.counts(bytes1, writes1);
+
+			char name[32];
+			snprintf(name, sizeof(name), "pool%d/u%d", pool, unison);
+			print_row(name, "alloc", ns, secs, writes1 - writes0, bytes1 - bytes0);
+		}
+	}
+}
+
+// --- Verification ---
+
+// One card of a verification rig, logging every decoded register write.
+struct VerifyCard {
+	LoopbackSerialPort port;
+	OPL3HardwareBuffer hw{port};
+	OPL3State state{hw};
+	DirectMode dm{state};
+
+	VerifyCard()
+	{
+		port.open("verify");
+		state.reset();
+		dm.init();
+		hw.flush();
+	}
+};
+
+// Seeded allocator workloads and the FNV-1a hash of the register stream
+// each one produces on the cards. Any change to which channels the
+// allocator picks, in what order, or what it writes to them changes the
+// hash. Update a hash only for an intended change in output.
+struct AllocCase {
+	const char *name;
+	int cards;
+	void (*setup)(VoiceAllocator &);
+	uint64_t golden;
+};
+
+// Unison voices on channels listed in ascending order.
+static void setup_sorted(VoiceAllocator &va)
+{
+	VoiceConfig vc;
+	vc.opl3_channels = {0, 1, 2, 3, 4, 5};
+	vc.unison_count = 3;
+	vc.detune_cents = 20;
+	vc.pan_split = true;
+	va.set_voice_config(0, vc);
+}
+
+// The same, listed out of order: the listed order sets each voice's
+// unison index, so its detune and pan-split side.
+static void setup_unsorted(VoiceAllocator &va)
+{
+	VoiceConfig vc;
+	vc.opl3_channels = {5, 2, 9, 0, 13, 7};
+	vc.unison_count = 3;
+	vc.detune_cents = 30;
+	vc.pan_split = true;
+	va.set_voice_config(0, vc);
+
+	VoiceConfig vc1;
+	vc1.opl3_channels = {17, 16};
+	va.set_voice_config(1, vc1);
+}
+
+// One pool spanning three cards.
+static void setup_cards(VoiceAllocator &va)
+{
+	VoiceConfig vc;
+	for (int ch = 0; ch < 3 * VoiceAllocator::kChannelsPerCard; ch += 2)
+		vc.opl3_channels.push_back(static_cast<uint8_t>(ch));
+	vc.unison_count = 2;
+	va.set_voice_config(0, vc);
+}
+
+// Shared pool with reservations, caps and priorities.
+static void setup_dynamic(VoiceAllocator &va)
+{
+	setup_cards(va);
+	ChannelLimits l0;
+	l0.min_voices = 4;
+	l0.priority = 100;
+	va.set_channel_limits(0, l0);
+	ChannelLimits l2;
+	l2.max_voices = 3;
+	l2.priority = 10;
+	va.set_channel_limits(2, l2);
+	va.set_pool_mode(PoolMode::Dynamic);
+}
+
+static const AllocCase kAllocCases[] = {
+	{"sorted", 1, setup_sorted, 0x3494f6553b4d7cc2ull},
+	{"unsorted", 1, setup_unsorted, 0x7feaa1ac08d3a111ull},
+	{"cards", 3, setup_cards, 0x141cfe771ec9bceeull},
+	{"dynamic", 3, setup_dynamic, 0xe5378997d47b8900ull},
+};
+
+// Notes, bends, sustain and CCs on MIDI channels 0-3.
+static std::vector<Event> make_alloc_mix(size_t n, std::mt19937 &rng)
+{
+	static const uint8_t kCCs[] = {1, 7, 10, 11, 74};
+	std::vector<Event> ev;
+	while (ev.size() < n) {
+		uint8_t ch = rng() % 4;
+		switch (rng() % 10) {
+		case 0: case 1: case 2: case 3:
+			ev.push_back(note_on(ch, 36 + rng() % 48, 1 + rng() % 127));
+			break;
+		case 4: case 5: case 6:
+			ev.push_back(note_off(ch, 36 + rng() % 48));
+			break;
+		case 7:
+			ev.push_back(bend(ch, rng() % 16384));
+			break;
+		case 8:
+			ev.push_back(cc(ch, 64, rng() % 128));
+			break;
+		default:
+			ev.push_back(cc(ch, kCCs[rng() % 5], rng() % 128));
+			break;
+		}
+	}
+	return ev;
+}
+
+static uint64_t fnv1a(uint64_t h, uint64_t v)
+{
+	return (h ^ v) * 1099511628211ull;
+}
+
+static bool verify_alloc(const AllocCase &c)
+{
+	std::vector<std::unique_ptr<VerifyCard>> cards;
+	for (int i = 0; i < c.cards; ++i)
+		cards.push_back(std::make_unique<VerifyCard>());
+	VoiceAllocator va(cards[0]->dm, cards[0]->state);
+	for (int i = 1; i < c.cards; ++i)
+		va.add_card(cards[i]->dm);
+	va.init_default_mapping();
+	c.setup(va);
+
+	std::mt19937 rng(42);
+	std::vector<Event> events = make_alloc_mix(50000, rng);
+	for (size_t i = 0; i < events.size(); ++i) {
+		va.process_midi(events[i].data(), events[i].size());
+		if (i % 7 == 0) {
+			for (auto &card : cards)
+				card->hw.flush();
+		}
+	}
+	va.reset();
+	for (auto &card : cards)
+		card->hw.flush();
+
+	bool ok = true;
+	uint64_t h = 1469598103934665603ull;
+	for (int i = 0; i < c.cards; ++i) {
+		const auto &card = *cards[i];
+		auto image = card.port.registers();
+		for (uint16_t addr = 0; addr < 512; ++addr) {
+			if (image[addr] != card.state.read(addr)) {
+				printf("  %s: card %d register 0x%03X: card 0x%02X, shadow 0x%02X\n",
+				       c.name, i, addr, image[addr], card.state.read(addr));
+				ok = false;
+				break;
+			}
+		}
+		for (const auto &e : card.port.log())
+			h = fnv1a(fnv1a(fnv1a(h, static_cast<uint64_t>(i)), e.addr), e.value);
+	}
+
+	bool match = h == c.golden;
+	printf("  alloc %-10s %016" PRIx64 " %s\n", c.name, h,
+	       match ? "ok" : "MISMATCH");
+	return ok && match;
+}
+
+// The attenuation formulas DirectMode evaluated per CC and note-on before
+// the lookup tables: -20*log10 of the product of two 0-127 levels, in
+// 0.75 dB steps, clamped to 0-63.
+static uint8_t ref_level_atten(uint8_t a, uint8_t b)
+{
+	if (a == 0 || b == 0)
+		return 63;
+	double combined = (a / 127.0) * (b / 127.0);
+	int atten = static_cast<int>(-20.0 * std::log10(combined) / 0.75 + 0.5);
+	return static_cast<uint8_t>(std::min(std::max(atten, 0), 63));
+}
+
+// The mod wheel x brightness variant, with its own cutoff for silence.
+static uint8_t ref_mod_atten(uint8_t a, uint8_t b)
+{
+	double combined = (a / 127.0) * (b / 127.0);
+	if (combined < 0.001)
+		return 63;
+	int atten = static_cast<int>(-20.0 * std::log10(combined) / 0.75 + 0.5);
+	return static_cast<uint8_t>(std::min(std::max(atten, 0), 63));
+}
+
+static uint8_t ref_velocity_atten(VelocityCurve curve, uint8_t vel)
+{
+	switch (curve) {
+	case VelocityCurve::ADL:         return ref_level_atten(vel, 127);
+	case VelocityCurve::Exponential: return ref_level_atten(vel, vel);
+	default:                         return static_cast<uint8_t>((127 - vel) >> 1);
+	}
+}
+
+// Every volume x expression and mod wheel x brightness pair, and every
+// velocity on each curve, checked through DirectMode channel 0 against
+// the formulas above.
+static bool verify_levels()
+{
+	VerifyCard card;
+	uint16_t mod_tl = opl3::kRegKSLTL + opl3::kOperatorOffset[0][0];
+	uint16_t car_tl = opl3::kRegKSLTL + opl3::kOperatorOffset[0][1];
+	int errors = 0;
+
+	auto check = [&](const char *what, int a, int b, uint16_t addr, uint8_t want) {
+		uint8_t got = card.state.read(addr) & 0x3F;
+		if (got != want && errors++ < 8)
+			printf("  %s %d/%d: 0x%02X, expected 0x%02X\n", what, a, b, got, want);
+	};
+
+	for (int a = 0; a < 128; ++a) {
+		for (int b = 0; b < 128; ++b) {
+			Event ev[] = {cc(0, 7, a), cc(0, 11, b), cc(0, 1, a), cc(0, 74, b)};
+			for (auto &e : ev)
+				card.dm.process_midi(e.data(), e.size());
+			check("volume/expression", a, b, car_tl, ref_level_atten(a, b));
+			check("mod/brightness", a, b, mod_tl, ref_mod_atten(a, b));
+		}
+	}
+
+	static const VelocityCurve kCurves[] = {
+		VelocityCurve::Linear, VelocityCurve::ADL, VelocityCurve::Exponential,
+	};
+	Event full[] = {cc(0, 7, 127), cc(0, 11, 127)};
+	for (auto &e : full)
+		card.dm.process_midi(e.data(), e.size());
+	for (auto curve : kCurves) {
+		card.dm.set_velocity_curve(curve);
+		for (int v = 1; v < 128; ++v) {
+			Event on = note_on(0, 60, v), off = note_off(0, 60);
+			card.dm.process_midi(on.data(), on.size());
+			check("velocity", static_cast<int>(curve), v, car_tl,
+			      ref_velocity_atten(curve, v));
+			card.dm.process_midi(off.data(), off.size());
+		}
+	}
+
+	printf("  levels     %s\n", errors ? "MISMATCH" : "ok");
+	return errors == 0;
+}
+
+// DirectMode's NRPN handling before the field tables (operator, channel
+// and global parameters as one switch each), applied to a second card.
+static void ref_nrpn(OPL3State &st, DirectMode &dm, uint8_t ch, uint8_t msb, uint8_t lsb,
+                     uint8_t val)
+{
+	using namespace opl3;
+	if (ch >= 18)
+		return;
+	uint16_t base = kChannelToOPL3[ch].port_base;
+	uint8_t opl_ch = kChannelToOPL3[ch].opl_ch;
+	uint8_t pair_ch = 0xFF;
+	int pair_idx = -1;
+	for (int i = 0; i < 3; ++i) {
+		if (kFourOpPairs[i][0] == opl_ch) {
+			pair_ch = kFourOpPairs[i][1];
+			pair_idx = i + (base == 0x100 ? 3 : 0);
+		}
+	}
+	auto bit = [&](uint8_t b) { return static_cast<uint8_t>(val >= 64 ? b : 0); };
+
+	if (msb <= 3) {
+		uint8_t op_off;
+		if (msb <= 1)
+			op_off = kOperatorOffset[opl_ch][msb];
+		else if (pair_ch != 0xFF)
+			op_off = kOperatorOffset[pair_ch][msb - 2];
+		else
+			return;
+		val &= 0x7F;
+		uint16_t op = base | op_off;
+		switch (lsb) {
+		case 0:  st.modify_bits(op + kRegAR_DR, 0xF0, (val >> 3) << 4); break;
+		case 1:  st.modify_bits(op + kRegAR_DR, 0x0F, val >> 3); break;
+		case 2:  st.modify_bits(op + kRegSL_RR, 0xF0, (val >> 3) << 4); break;
+		case 3:  st.modify_bits(op + kRegSL_RR, 0x0F, val >> 3); break;
+		case 4:  st.modify_bits(op + kRegWaveform, 0x07, val >> 4); break;
+		case 5:  st.modify_bits(op + kRegAMVibEGKSMult, 0x0F, val >> 3); break;
+		case 6:  st.modify_bits(op + kRegKSLTL, 0x3F, val >> 1); break;
+		case 7:  st.modify_bits(op + kRegKSLTL, 0xC0, (val >> 5) << 6); break;
+		case 8:  st.modify_bits(op + kRegAMVibEGKSMult, 0x80, bit(0x80)); break;
+		case 9:  st.modify_bits(op + kRegAMVibEGKSMult, 0x40, bit(0x40)); break;
+		case 10: st.modify_bits(op + kRegAMVibEGKSMult, 0x20, bit(0x20)); break;
+		case 11: st.modify_bits(op + kRegAMVibEGKSMult, 0x10, bit(0x10)); break;
+		default: break;
+		}
+	} else if (msb == 4) {
+		uint16_t c0 = base | (kRegFeedbackConn + opl_ch);
+		switch (lsb) {
+		case 0: st.modify_bits(c0, 0x0E, (val >> 4) << 1); break;
+		case 1: st.modify_bits(c0, 0x01, bit(0x01)); break;
+		case 2: st.modify_bits(c0, 0x10, bit(0x10)); break;
+		case 3: st.modify_bits(c0, 0x20, bit(0x20)); break;
+		case 4:
+			if (pair_idx >= 0)
+				st.modify_bits(kReg4OpEnable, kFourOpEnableBit[pair_idx],
+				               bit(kFourOpEnableBit[pair_idx]));
+			break;
+		case 5:
+			if (pair_ch != 0xFF)
+				st.modify_bits(base | (kRegFeedbackConn + pair_ch), 0x01, bit(0x01));
+			break;
+		default: break;
+		}
+	} else if (msb == 5) {
+		switch (lsb) {
+		case 0: st.modify_bits(kRegBD, 0x80, bit(0x80)); break;
+		case 1: st.modify_bits(kRegBD, 0x40, bit(0x40)); break;
+		case 2: st.modify_bits(kRegBD, 0x20, bit(0x20)); break;
+		case 3: dm.set_velocity_curve(static_cast<VelocityCurve>(val / 43)); break;
+		default: break;
+		}
+	}
+}
+
+// Random NRPNs, in and out of range, over randomised registers: both
+// cards must hold the same registers and velocity curve after each one.
+static bool verify_nrpn()
+{
+	VerifyCard card, ref;
+	card.port.set_logging(false);
+	ref.port.set_logging(false);
+	std::mt19937 rng(7);
+	for (uint16_t addr = 0; addr < 512; ++addr) {
+		uint8_t v = rng();
+		card.state.write(addr, v);
+		ref.state.write(addr, v);
+	}
+
+	bool ok = true;
+	for (int i = 0; i < 300000 && ok; ++i) {
+		uint8_t ch = rng() % 19, msb = rng() % 7, lsb = rng() % 14, val = rng() % 128;
+		card.dm.direct_nrpn(ch, msb, lsb, val);
+		ref_nrpn(ref.state, ref.dm, ch, msb, lsb, val);
+		for (uint16_t addr = 0; addr < 512; ++addr) {
+			if (card.state.read(addr) != ref.state.read(addr)) {
+				printf("  nrpn ch %u %u/%u = %u: register 0x%03X 0x%02X, expected 0x%02X\n",
+				       ch, msb, lsb, val, addr, card.state.read(addr), ref.state.read(addr));
+				ok = false;
+				break;
+			}
+		}
+		ok &= card.dm.velocity_curve() == ref.dm.velocity_curve();
+	}
+
+	printf("  nrpn       %s\n", ok ? "ok" : "MISMATCH");
+	return ok;
+}
+
+static bool run_verify()
+{
+	bool ok = true;
+	for (const auto &c : kAllocCases)
+		ok &= verify_alloc(c);
+	ok &= verify_levels();
+	ok &= verify_nrpn();
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	size_t events = 100000;
+	size_t batch = 1;
+	bool loopback = false;
+	bool sweep = false;
+	bool verify = false;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--events" && i + 1 < argc) {
+			events = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--batch" && i + 1 < argc) {
+			batch = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+		} else if (arg == "--loopback") {
+			loopback = true;
+		} else if (arg == "--sweep") {
+			sweep = true;
+		} else if (arg == "--verify") {
+			verify = true;
+		} else {
+			fprintf(stderr, "Usage: %s [--events N] [--batch N] [--loopback] [--sweep] [--verify]\n",
+			        argv[0]);
+			return 1;
+		}
+	}
+
+	if (verify) {
+		if (!run_verify()) {
+			fprintf(stderr, "verification FAILED\n");
+			return 1;
+		}
+		printf("verification passed\n");
+		return 0;
+	}
+
+	if (sweep) {
+		printf("%zu chord-storm events per row, flush every %zu, null sink\n\n",
+		       events, batch);
+		print_header();
+		run_sweep(events, batch);
+		return 0;
+	}
+
+	static const Workload kWorkloads[] = {
+		{"note-storm", make_note_storm, false},
+		{"cc-flood", make_cc_flood, false},
+		{"bend-unison", make_bend_sweep, true},
+		{"sysex-batch", make_sysex_batch, false},
+		{"patch-load", make_patch_load, false},
+	};
+
+	printf("%zu events per workload, flush every %zu, %s sink\n\n",
+	       events, batch, loopback ? "loopback" : "null");
+	print_header();
+
+	bool ok = true;
+	for (const auto &w : kWorkloads) {
+		ok &= run(w, Target::Allocator, events, batch, loopback);
+		if (!w.unison)
+			ok &= run(w, Target::Direct, events, batch, loopback);
+	}
+
+	if (!ok) {
+		fprintf(stderr, "loopback register image does not match the shadow\n");
+		return 1;
+	}
+	return 0;
+}
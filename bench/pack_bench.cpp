@@ -0,0 +1,287 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Verifies protocol_serial_pack() against protocol_serial_pack_ref() and
+// the decoding side (ProtocolDecoder, protocol_parse_opl3) against known
+// streams, then times both packers on typical frame sizes. Exits non-zero
+// on any mismatch.
+
+#include <retrowave/protocol.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace retrowave;
+
+static bool check(const uint8_t *in, size_t len)
+{
+	std::vector<uint8_t> a(len * 2 + 8, 0xAA), b(len * 2 + 8, 0x55);
+	size_t la = protocol_serial_pack(in, len, a.data());
+	size_t lb = protocol_serial_pack_ref(in, len, b.data());
+	if (la != lb || std::memcmp(a.data(), b.data(), la) != 0) {
+		fprintf(stderr, "MISMATCH at len=%zu (got %zu bytes, expected %zu)\n", len, la, lb);
+		return false;
+	}
+	return true;
+}
+
+static bool verify()
+{
+	// Every 1- and 2-byte input
+	for (int x = 0; x < 256; ++x) {
+		uint8_t in[1] = {static_cast<uint8_t>(x)};
+		if (!check(in, 1)) return false;
+	}
+	for (int x = 0; x < 65536; ++x) {
+		uint8_t in[2] = {static_cast<uint8_t>(x >> 8), static_cast<uint8_t>(x)};
+		if (!check(in, 2)) return false;
+	}
+
+	// Every byte value at every position, for all lengths up to 3 blocks
+	// plus a remainder, over zero, all-ones and random backgrounds.
+	std::mt19937 rng(1234);
+	for (size_t len = 0; len <= 24; ++len) {
+		for (int bg = 0; bg < 3; ++bg) {
+			std::vector<uint8_t> in(len);
+			for (auto &v : in)
+				v = bg == 0 ? 0x00 : bg == 1 ? 0xFF : static_cast<uint8_t>(rng());
+			if (!check(in.data(), len)) return false;
+			for (size_t pos = 0; pos < len; ++pos) {
+				uint8_t saved = in[pos];
+				for (int x = 0; x < 256; ++x) {
+					in[pos] = static_cast<uint8_t>(x);
+					if (!check(in.data(), len)) return false;
+				}
+				in[pos] = saved;
+			}
+		}
+	}
+
+	// Random frames of every length up to a full init frame
+	for (size_t len = 0; len <= 4096; ++len) {
+		std::vector<uint8_t> in(len);
+		for (auto &v : in)
+			v = static_cast<uint8_t>(rng());
+		if (!check(in.data(), len)) return false;
+	}
+
+	return true;
+}
+
+// --- Decoder verification ---
+
+// Raw command stream for a list of register writes, as built by
+// OPL3HardwareBuffer: header, then address/data/strobe pairs per write.
+static std::vector<uint8_t> encode_writes(const std::vector<OPL3RegWrite> &writes)
+{
+	std::vector<uint8_t> raw = {0x21 << 1, 0x12};
+	for (const auto &w : writes) {
+		bool port1 = w.addr & 0x100;
+		const uint8_t cmd[] = {
+			static_cast<uint8_t>(port1 ? 0xe5 : 0xe1), w.reg(),
+			static_cast<uint8_t>(port1 ? 0xe7 : 0xe3), w.value,
+			0xfb, w.value,
+		};
+		raw.insert(raw.end(), cmd, cmd + sizeof(cmd));
+	}
+	return raw;
+}
+
+static std::vector<uint8_t> pack(const std::vector<uint8_t> &raw)
+{
+	std::vector<uint8_t> out(raw.size() * 2 + 8);
+	out.resize(protocol_serial_pack(raw.data(), raw.size(), out.data()));
+	return out;
+}
+
+static bool same_writes(const std::vector<OPL3RegWrite> &a, const std::vector<OPL3RegWrite> &b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); ++i) {
+		if (a[i].addr != b[i].addr || a[i].value != b[i].value)
+			return false;
+	}
+	return true;
+}
+
+// Feeds stream in chunks of 1..max_chunk bytes; returns the frames seen.
+static std::vector<std::vector<uint8_t>> decode(ProtocolDecoder &dec,
+                                                const std::vector<uint8_t> &stream,
+                                                size_t max_chunk, std::mt19937 &rng)
+{
+	std::vector<std::vector<uint8_t>> frames;
+	auto fn = [&](const uint8_t *raw, size_t len) { frames.emplace_back(raw, raw + len); };
+	for (size_t pos = 0; pos < stream.size();) {
+		size_t n = std::min<size_t>(1 + rng() % max_chunk, stream.size() - pos);
+		dec.feed(stream.data() + pos, n, fn);
+		pos += n;
+	}
+	return frames;
+}
+
+static bool fail(const char *what)
+{
+	fprintf(stderr, "decoder: %s\n", what);
+	return false;
+}
+
+static bool verify_decoder()
+{
+	std::mt19937 rng(4321);
+
+	// Golden frame: writes 0x0B0 = 0x2A and 0x1C3 = 0x35
+	static const uint8_t kGolden[] = {
+		0x00, 0x43, 0x09, 0xB9, 0x37, 0x0F, 0x19, 0xAB, 0xF7,
+		0x2B, 0x73, 0x71, 0x7D, 0x73, 0xAF, 0xED, 0x6B, 0x02,
+	};
+	const std::vector<OPL3RegWrite> golden_writes = {{0x0B0, 0x2A}, {0x1C3, 0x35}};
+	std::vector<uint8_t> golden(kGolden, kGolden + sizeof(kGolden));
+	if (pack(encode_writes(golden_writes)) != golden)
+		return fail("golden frame packs differently");
+	std::vector<uint8_t> raw;
+	std::vector<OPL3RegWrite> writes;
+	if (!protocol_serial_unpack(golden.data(), golden.size(), raw) ||
+	    !protocol_parse_opl3(raw.data(), raw.size(), writes) ||
+	    !same_writes(writes, golden_writes))
+		return fail("golden frame does not unpack to its writes");
+
+	// Random frames, fed whole and one byte at a time, with garbage that
+	// contains no start byte between them
+	for (size_t max_chunk : {size_t(1), size_t(3), size_t(64), size_t(4096)}) {
+		std::vector<std::vector<uint8_t>> sent;
+		std::vector<uint8_t> stream;
+		for (int f = 0; f < 200; ++f) {
+			std::vector<uint8_t> frame(rng() % 600);
+			for (auto &v : frame)
+				v = static_cast<uint8_t>(rng());
+			sent.push_back(frame);
+			auto packed = pack(frame);
+			stream.insert(stream.end(), packed.begin(), packed.end());
+			for (unsigned g = rng() % 4; g > 0; --g)
+				stream.push_back(static_cast<uint8_t>(1 + rng() % 255));
+		}
+		ProtocolDecoder dec;
+		if (decode(dec, stream, max_chunk, rng) != sent || dec.malformed_frames() != 0)
+			return fail("split stream does not decode to the frames sent");
+	}
+
+	// Corruption: an even byte inside a frame drops that frame only; a
+	// frame cut short by the next start byte is discarded without counting
+	{
+		auto a = pack({1, 2, 3, 4, 5, 6, 7, 8});
+		auto b = pack({9, 10, 11});
+		std::vector<uint8_t> stream;
+		auto bad = a;
+		bad[3] &= 0xFE;
+		stream.insert(stream.end(), bad.begin(), bad.end());
+		stream.insert(stream.end(), b.begin(), b.end());
+		stream.insert(stream.end(), a.begin(), a.end() - 4);
+		stream.insert(stream.end(), b.begin(), b.end());
+		stream.push_back(0x02);
+		ProtocolDecoder dec;
+		auto frames = decode(dec, stream, 1, rng);
+		std::vector<std::vector<uint8_t>> want = {{9, 10, 11}, {9, 10, 11}};
+		if (frames != want || dec.malformed_frames() != 1)
+			return fail("corrupted stream does not resync");
+
+		std::vector<uint8_t> out;
+		if (protocol_serial_unpack(bad.data(), bad.size(), out) ||
+		    protocol_serial_unpack(a.data(), a.size() - 1, out))
+			return fail("malformed frame unpacks");
+	}
+
+	// Register streams: random writes round-trip; malformed commands fail
+	for (int n = 0; n < 500; ++n) {
+		std::vector<OPL3RegWrite> sent(rng() % 64);
+		for (auto &w : sent)
+			w = {static_cast<uint16_t>(rng() % 512), static_cast<uint8_t>(rng())};
+		auto stream = pack(encode_writes(sent));
+		ProtocolDecoder dec;
+		auto frames = decode(dec, stream, 1 + n % 16, rng);
+		writes.clear();
+		if (frames.size() != 1 ||
+		    !protocol_parse_opl3(frames[0].data(), frames[0].size(), writes) ||
+		    !same_writes(writes, sent))
+			return fail("register writes do not round-trip");
+	}
+	static const std::vector<uint8_t> kMalformed[] = {
+		{},                                        // no header
+		{0x21 << 1, 0x13},                         // bad header
+		{0x21 << 1, 0x12, 0xe3, 0x01},             // data before address
+		{0x21 << 1, 0x12, 0xe1, 0xb0, 0xe7, 0x01}, // port 0 address, port 1 data
+		{0x21 << 1, 0x12, 0xe5, 0xb0, 0xe3, 0x01}, // port 1 address, port 0 data
+		{0x21 << 1, 0x12, 0xe1, 0xb0, 0x42, 0x01}, // unknown control byte
+		{0x21 << 1, 0x12, 0xe1, 0xb0, 0xe3},       // odd length
+	};
+	for (const auto &m : kMalformed) {
+		writes.clear();
+		if (protocol_parse_opl3(m.data(), m.size(), writes))
+			return fail("malformed register stream parses");
+	}
+
+	return true;
+}
+
+using PackFn = size_t (*)(const uint8_t *, size_t, uint8_t *);
+
+static double time_ns(PackFn fn, const std::vector<uint8_t> &in, int iters)
+{
+	std::vector<uint8_t> out(in.size() * 2 + 8);
+	volatile size_t sink = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	for (int i = 0; i < iters; ++i)
+		sink = sink + fn(in.data(), in.size(), out.data());
+	auto t1 = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(t1 - t0).count() / iters;
+}
+
+int main()
+{
+	if (!verify()) {
+		fprintf(stderr, "protocol_serial_pack does not match the reference\n");
+		return 1;
+	}
+	printf("verify: protocol_serial_pack matches reference\n");
+	if (!verify_decoder()) {
+		fprintf(stderr, "protocol decoding does not match known streams\n");
+		return 1;
+	}
+	printf("verify: decoder and register parser match known streams\n\n");
+
+	// 8 = one register write, 62 = a note-on with a few CCs,
+	// 2402 = OPL3State::reset() + DirectMode::init()
+	static const size_t kSizes[] = {8, 62, 602, 2402};
+
+	std::mt19937 rng(42);
+	printf("%8s %14s %14s %8s\n", "bytes", "ref ns/frame", "fast ns/frame", "speedup");
+	for (size_t size : kSizes) {
+		std::vector<uint8_t> in(size);
+		for (auto &v : in)
+			v = static_cast<uint8_t>(rng());
+		int iters = static_cast<int>(20000000 / size) + 1;
+		double ref = time_ns(protocol_serial_pack_ref, in, iters);
+		double fast = time_ns(protocol_serial_pack, in, iters);
+		printf("%8zu %14.1f %14.1f %7.2fx\n", size, ref, fast, ref / fast);
+	}
+
+	return 0;
+}
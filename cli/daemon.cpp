@@ -17,73 +17,99 @@
 
 #include "daemon.h"
 
-#include <cassert>
+#include <cerrno>
 #include <cstdio>
 #include <cstring>
 #include <ctime>
 #include <dirent.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
-
-// The same RetroWaveOPL3 chip class used in the GUI, adapted for CLI.
-class RetroWaveOPL3CLI final : public OPLChipBaseT<RetroWaveOPL3CLI> {
-public:
-	retrowave::OPL3HardwareBuffer *hw_;
-
-	RetroWaveOPL3CLI(retrowave::OPL3HardwareBuffer *hw) : hw_(hw) {
-		hw_->reset();
-
-		writeReg(0x004, 96);
-		writeReg(0x004, 128);
-		writeReg(0x105, 0x0);
-		writeReg(0x105, 0x1);
-		writeReg(0x105, 0x0);
-		writeReg(0x001, 32);
-		writeReg(0x105, 0x1);
-	}
-
-	bool canRunAtPcmRate() const override { return true; }
-
-	void writeReg(uint16_t addr, uint8_t data) override {
-		hw_->queue(addr, data);
-	}
-
-	void nativePreGenerate() override {}
-	void nativePostGenerate() override {}
-	void nativeGenerate(int16_t *frame) override {}
-	const char *emulatorName() override { return "RetroWave"; }
-	ChipType chipType() override { return CHIPTYPE_OPL3; }
-};
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 Daemon::Daemon()
 {
-	router_.set_direct_mode(&direct_mode_);
+	router_.set_direct_mode(&cards_.front()->direct);
 	router_.set_voice_allocator(&voice_alloc_);
 
 	// Wire up MIDI output for SysEx responses (patch dumps, voice queries)
-	auto midi_out_fn = [this](const std::vector<uint8_t> &msg) {
-		if (midiout_ && midiout_->isPortOpen())
-			midiout_->sendMessage(&msg);
-	};
-	direct_mode_.set_midi_output(midi_out_fn);
+	auto midi_out_fn = [this](const std::vector<uint8_t> &msg) { send_midi(msg); };
+	cards_.front()->direct.set_midi_output(midi_out_fn);
 	voice_alloc_.set_midi_output(midi_out_fn);
 }
 
 Daemon::~Daemon()
 {
 	cleanup();
+	if (wake_fd_ >= 0)
+		close(wake_fd_);
+	if (timer_fd_ >= 0)
+		close(timer_fd_);
+}
+
+std::vector<std::unique_ptr<Daemon::Card>> Daemon::make_cards()
+{
+	std::vector<std::unique_ptr<Card>> cards;
+	cards.push_back(std::make_unique<Card>());
+	return cards;
+}
+
+bool Daemon::add_serial_port(const std::string &port)
+{
+	if (cards_.front()->port_name.empty()) {
+		cards_.front()->port_name = port;
+		return true;
+	}
+	if (cards_.size() >= retrowave::VoiceAllocator::kMaxCards)
+		return false;
+
+	cards_.push_back(std::make_unique<Card>());
+	cards_.back()->port_name = port;
+	voice_alloc_.add_card(cards_.back()->direct);
+	return true;
+}
+
+void Daemon::send_midi(const std::vector<uint8_t> &msg)
+{
+	if (midiout_ && midiout_->isPortOpen())
+		midiout_->sendMessage(&msg);
+}
+
+bool Daemon::init_engine()
+{
+	wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (wake_fd_ < 0) {
+		fprintf(stderr, "Error: failed to create wakeup eventfd: %s\n", strerror(errno));
+		return false;
+	}
+
+	// Bank mode depends on the tick timer to advance libADLMIDI
+	if (router_.mode() == retrowave::RoutingMode::Bank) {
+		timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+		if (timer_fd_ < 0) {
+			fprintf(stderr, "Error: failed to create bank-mode tick timer: %s\n",
+			        strerror(errno));
+			return false;
+		}
+	}
+	return true;
 }
 
 bool Daemon::init_serial()
 {
-	if (serial_port_name_.empty()) {
+	if (cards_.front()->port_name.empty()) {
 		fprintf(stderr, "Error: no serial port specified\n");
 		return false;
 	}
 
-	if (!serial_.open(serial_port_name_)) {
-		fprintf(stderr, "Error: failed to open serial port: %s\n",
-		        serial_port_name_.c_str());
-		return false;
+	for (auto &card : cards_) {
+		if (!card->serial.open(card->port_name)) {
+			fprintf(stderr, "Error: failed to open serial port: %s\n",
+			        card->port_name.c_str());
+			return false;
+		}
+		card->hw.set_max_frame_writes(max_frame_writes_);
 	}
 
 	return true;
@@ -132,8 +158,13 @@ bool Daemon::init_midi()
 bool Daemon::init_adlmidi()
 {
 	if (router_.mode() == retrowave::RoutingMode::Direct) {
-		direct_mode_.init();
-		hw_buf_.flush();
+		for (auto &card : cards_) {
+			card->direct.init();
+			card->hw.flush();
+		}
+		if (cards_.size() > 1)
+			fprintf(stderr, "Direct mode: %d OPL3 channels over %zu cards\n",
+			        voice_alloc_.channel_count(), cards_.size());
 		return true;
 	}
 
@@ -143,7 +174,7 @@ bool Daemon::init_adlmidi()
 		return false;
 	}
 
-	adl_setNumChips(adl_midi_player_, 1);
+	adl_setNumChips(adl_midi_player_, static_cast<int>(cards_.size()));
 	adl_setSoftPanEnabled(adl_midi_player_, 1);
 	adl_setVolumeRangeModel(adl_midi_player_, volmodel_id_);
 
@@ -166,19 +197,21 @@ bool Daemon::init_adlmidi()
 	auto *synth = real_midiplay->m_synth.get();
 	auto &chips = synth->m_chips;
 
-	auto *opl3 = new RetroWaveOPL3CLI(&hw_buf_);
-	assert(chips.size() == 1);
-	chips[0].reset(opl3);
+	if (chips.size() != cards_.size()) {
+		fprintf(stderr, "Error: ADLMIDI has %zu chips for %zu cards\n",
+		        chips.size(), cards_.size());
+		adl_close(adl_midi_player_);
+		adl_midi_player_ = nullptr;
+		return false;
+	}
 
-	adl_midi_sequencer_ = real_midiplay->m_sequencer.get();
+	// One card per chip: libADLMIDI spreads voices across all of them
+	for (size_t i = 0; i < chips.size(); ++i)
+		chips[i].reset(new retrowave::RetroWaveADLChip(cards_[i]->state));
 
 	synth->updateChannelCategories();
 	synth->silenceAll();
 
-	for (unsigned i = 0; i < 16; i++)
-		adl_midi_sequencer_->setChannelEnabled(i, true);
-	adl_midi_sequencer_->m_trackDisable.resize(16);
-
 	return true;
 }
 
@@ -196,18 +229,70 @@ void Daemon::cleanup()
 		midiout_ = nullptr;
 	}
 
-	adl_midi_sequencer_ = nullptr;
-
 	if (adl_midi_player_) {
 		adl_close(adl_midi_player_);
 		adl_midi_player_ = nullptr;
 	}
 
-	serial_.close();
+	// Drain queued frames before the ports go away
+	for (auto &card : cards_) {
+		card->writer.stop();
+		card->serial.close();
+	}
+}
+
+void Daemon::print_stats()
+{
+	fprintf(stderr, "Tick jitter (%.3f ms period): %s, %llu overruns\n",
+	        tick_ns_ / 1e6, tick_jitter_.summary().c_str(),
+	        static_cast<unsigned long long>(tick_overruns_));
+
+	double secs = (retrowave::monotonic_ns() - run_start_ns_) / 1e9;
+	if (secs > 0)
+		fprintf(stderr, "Engine: %llu wakeups (%.1f/s), %llu idle (%.1f/s) over %.1f s\n",
+		        static_cast<unsigned long long>(wakeups_), wakeups_ / secs,
+		        static_cast<unsigned long long>(idle_wakeups_), idle_wakeups_ / secs, secs);
+
+	fprintf(stderr, "MIDI timing (%s, %.2f ms latency): %s, %llu re-anchors\n",
+	        latency_ns_ ? "deadline lateness" : "queue delay",
+	        latency_ns_ / 1e6, jitter_.summary().c_str(),
+	        static_cast<unsigned long long>(midi_clock_.reanchors()));
+
+	auto mq = midi_queue_.stats();
+	fprintf(stderr, "MIDI queue: %llu messages, depth %zu/%zu (max %zu), "
+	        "%llu oversize, %llu dropped (full), %llu dropped (oversize)\n",
+	        static_cast<unsigned long long>(mq.pushed),
+	        mq.depth, mq.capacity, mq.max_depth,
+	        static_cast<unsigned long long>(mq.oversize),
+	        static_cast<unsigned long long>(mq.dropped_full),
+	        static_cast<unsigned long long>(mq.dropped_oversize));
+
+	unsigned long long elided = 0, coalesced = 0;
+	for (auto &card : cards_) {
+		auto st = card->writer.stats();
+		fprintf(stderr, "Serial %s: %llu frames, %llu bytes, ring %zu/%zu (max %zu), "
+		        "%llu ring-full stalls, %llu slow writes, %llu write errors\n",
+		        card->port_name.c_str(),
+		        static_cast<unsigned long long>(st.frames),
+		        static_cast<unsigned long long>(st.bytes),
+		        st.occupancy, st.capacity, st.max_occupancy,
+		        static_cast<unsigned long long>(st.ring_full_stalls),
+		        static_cast<unsigned long long>(st.slow_writes),
+		        static_cast<unsigned long long>(st.write_errors));
+		elided += card->state.elided_writes();
+		coalesced += card->hw.coalesced_writes();
+	}
+
+	// Each elided write is one 6-byte register command before packing
+	fprintf(stderr, "Elided %llu redundant register writes, coalesced %llu "
+	        "(%llu bytes before packing)\n",
+	        elided, coalesced, (elided + coalesced) * 6);
 }
 
 int Daemon::run()
 {
+	if (!init_engine())
+		return 1;
 	if (!init_serial())
 		return 1;
 	if (!init_midi())
@@ -215,49 +300,225 @@ int Daemon::run()
 	if (!init_adlmidi())
 		return 1;
 
-	fprintf(stderr, "Running in %s mode. Press Ctrl+C to stop.\n",
-	        router_.mode() == retrowave::RoutingMode::Direct ? "direct" : "bank");
+	// Init frames above were written synchronously; from here on each
+	// card's I/O thread owns its serial port.
+	for (auto &card : cards_)
+		card->writer.start();
 
-	struct timespec ts;
-	ts.tv_sec = 0;
-	ts.tv_nsec = 1000000; // 1ms
+	fprintf(stderr, "Running in %s mode on %zu card%s. Press Ctrl+C to stop.\n",
+	        router_.mode() == retrowave::RoutingMode::Direct ? "direct" : "bank",
+	        cards_.size(), cards_.size() == 1 ? "" : "s");
 
-	while (!should_stop_) {
-		{
-			std::lock_guard<std::mutex> lg(hw_buf_.mutex());
+	if (latency_ns_)
+		fprintf(stderr, "Fixed MIDI latency: %.2f ms\n", latency_ns_ / 1e6);
 
-			if (router_.mode() == retrowave::RoutingMode::Bank && adl_midi_player_) {
-				int16_t discard[8];
-				adl_generate(adl_midi_player_, 2, discard);
-			}
+	run_start_ns_ = retrowave::monotonic_ns();
 
-			hw_buf_.flush();
+	// This loop is the engine thread: it alone touches the OPL3 chain.
+	// It sleeps in ppoll() and only wakes for MIDI input (wake_fd_), the
+	// next event deadline (fixed latency), or a bank-mode tick (timer_fd_,
+	// armed only while notes may sound).
+	while (!should_stop_) {
+		int64_t now = retrowave::monotonic_ns();
+		bool worked = false;
+
+		// Each event is due at its timestamp plus the fixed latency.
+		// jitter_ records how far past that deadline it was handled.
+		worked |= midi_queue_.drain_until(now - latency_ns_, [&](const uint8_t *data, size_t len, int64_t t) {
+			process_message(data, len);
+			jitter_.record(now - (t + latency_ns_));
+		}) > 0;
+
+		bool ticking = router_.mode() == retrowave::RoutingMode::Bank &&
+		               adl_midi_player_ && bank_active(now);
+		set_ticking(ticking, now);
+
+		if (ticks_due_) {
+			advance_bank(retrowave::monotonic_ns());
+			ticks_due_ = 0;
+			worked = true;
 		}
 
-		nanosleep(&ts, nullptr);
+		// Hand each card's frame to its own I/O thread
+		for (auto &card : cards_) {
+			worked |= !card->hw.empty();
+			card->hw.flush();
+		}
+		if (!worked)
+			idle_wakeups_++;
+
+		if (stats_requested_.exchange(false))
+			print_stats();
+
+		int64_t wake = INT64_MAX;
+		int64_t t;
+		if (midi_queue_.front_time(t))
+			wake = t + latency_ns_;
+		wait_for_wakeup(wake);
+		wakeups_++;
 	}
 
 	fprintf(stderr, "Shutting down...\n");
 	cleanup();
+	print_stats();
 	return 0;
 }
 
-void Daemon::midi_on_receive(double timeStamp, std::vector<unsigned char> *message, void *userData)
+void Daemon::wait_for_wakeup(int64_t deadline_ns)
 {
-	auto *ctx = static_cast<Daemon *>(userData);
-	std::lock_guard<std::mutex> lg(ctx->hw_buf_.mutex());
+	struct timespec ts;
+	struct timespec *timeout = nullptr;
+	if (deadline_ns != INT64_MAX) {
+		int64_t delay = deadline_ns - retrowave::monotonic_ns();
+		if (delay < 0)
+			delay = 0;
+		ts.tv_sec = delay / 1000000000;
+		ts.tv_nsec = delay % 1000000000;
+		timeout = &ts;
+	}
 
-	if (ctx->router_.process(message->data(), message->size()))
+	struct pollfd pfd[2];
+	pfd[0].fd = wake_fd_;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = timer_armed_ ? timer_fd_ : -1; // negative fds are ignored
+	pfd[1].events = POLLIN;
+	if (ppoll(pfd, 2, timeout, nullptr) <= 0)
 		return;
 
-	auto *ams = ctx->adl_midi_sequencer_;
-	if (!ams) return;
+	uint64_t count;
+	if (pfd[0].revents & POLLIN) {
+		ssize_t r = read(wake_fd_, &count, sizeof(count));
+		(void)r;
+	}
+	if ((pfd[1].revents & POLLIN) &&
+	    read(timer_fd_, &count, sizeof(count)) == sizeof(count) && count > 0) {
+		// cyclictest-style: how late we woke relative to the expiry
+		int64_t woke = retrowave::monotonic_ns();
+		tick_index_ += count;
+		tick_jitter_.record(woke - (timer_first_ns_ + static_cast<int64_t>(tick_index_ - 1) * tick_ns_));
+		tick_overruns_ += count - 1;
+		ticks_due_ += count;
+	}
+}
+
+void Daemon::set_ticking(bool on, int64_t now)
+{
+	if (on == timer_armed_)
+		return;
+
+	// Absolute, periodic CLOCK_MONOTONIC timer: expiries stay on the
+	// start + n * period grid however long each iteration takes.
+	struct itimerspec its = {};
+	if (on) {
+		last_advance_ns_ = now;
+		timer_first_ns_ = now + tick_ns_;
+		tick_index_ = 0;
+		its.it_value.tv_sec = timer_first_ns_ / 1000000000;
+		its.it_value.tv_nsec = timer_first_ns_ % 1000000000;
+		its.it_interval.tv_sec = tick_ns_ / 1000000000;
+		its.it_interval.tv_nsec = tick_ns_ % 1000000000;
+	}
+	timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &its, nullptr);
+	timer_armed_ = on;
+}
 
-	const uint8_t *pp = message->data();
-	int s = 0;
-	auto evt = ams->parseEvent(&pp, pp + message->size(), s);
-	int32_t s2 = 0;
-	ams->handleEvent(0, evt, s2);
+void Daemon::advance_bank(int64_t now)
+{
+	// Advance libADLMIDI's vibrato/portamento/arpeggio/release state by the
+	// real elapsed time. No PCM is rendered: the chip is the hardware.
+	static constexpr int64_t kMaxStepNs = 1000000000; // 1s
+	int64_t elapsed = now - last_advance_ns_;
+	last_advance_ns_ = now;
+	if (elapsed <= 0)
+		return;
+	if (elapsed > kMaxStepNs)
+		elapsed = kMaxStepNs;
+	adl_tickIterators(adl_midi_player_, elapsed / 1e9);
+}
+
+void Daemon::request_stats()
+{
+	stats_requested_ = true;
+	wake();
+}
+
+void Daemon::wake()
+{
+	// eventfd write is async-signal-safe, so this is also used by request_stop()
+	if (wake_fd_ >= 0) {
+		uint64_t one = 1;
+		ssize_t r = write(wake_fd_, &one, sizeof(one));
+		(void)r;
+	}
+}
+
+void Daemon::request_stop()
+{
+	should_stop_ = true;
+	wake();
+}
+
+void Daemon::track_activity(const uint8_t *data, size_t len)
+{
+	if (len == 1 && data[0] == 0xFF) { // System reset
+		held_keys_.reset();
+		sustain_mask_ = 0;
+		return;
+	}
+	if (len < 3)
+		return;
+
+	uint8_t status = data[0] & 0xF0;
+	uint8_t ch = data[0] & 0x0F;
+	switch (status) {
+	case 0x90:
+		held_keys_.set(ch * 128 + (data[1] & 0x7F), data[2] != 0);
+		break;
+	case 0x80:
+		held_keys_.reset(ch * 128 + (data[1] & 0x7F));
+		break;
+	case 0xB0:
+		if (data[1] == 64) {
+			if (data[2] >= 64)
+				sustain_mask_ |= static_cast<uint16_t>(1u << ch);
+			else
+				sustain_mask_ &= static_cast<uint16_t>(~(1u << ch));
+		} else if (data[1] == 120 || data[1] == 123) {
+			for (int k = 0; k < 128; ++k)
+				held_keys_.reset(ch * 128 + k);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+bool Daemon::bank_active(int64_t now) const
+{
+	// libADLMIDI needs ticks for vibrato, portamento, arpeggio and note
+	// delays; keep ticking a while after the last event for releases.
+	static constexpr int64_t kHoldOverNs = 2000000000; // 2s
+	return held_keys_.any() || sustain_mask_ || now - last_midi_ns_ < kHoldOverNs;
+}
+
+void Daemon::process_message(const uint8_t *data, size_t len)
+{
+	track_activity(data, len);
+	last_midi_ns_ = retrowave::monotonic_ns();
+
+	if (router_.process(data, len))
+		return;
+
+	if (adl_midi_player_)
+		retrowave::adl_rt_dispatch(adl_midi_player_, data, len);
+}
+
+void Daemon::midi_on_receive(double timeStamp, std::vector<unsigned char> *message, void *userData)
+{
+	auto *ctx = static_cast<Daemon *>(userData);
+	int64_t t = ctx->midi_clock_.stamp(timeStamp, retrowave::monotonic_ns());
+	ctx->midi_queue_.push(message->data(), message->size(), t);
+	ctx->wake();
 }
 
 void Daemon::midi_on_error(RtMidiError::Type type, const std::string &errorText, void *userData)
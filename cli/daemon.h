@@ -18,22 +18,28 @@
 #pragma once
 
 #include <atomic>
-#include <mutex>
+#include <bitset>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <retrowave/serial_posix.h>
+#include <retrowave/serial_writer.h>
 #include <retrowave/opl3_hw.h>
 #include <retrowave/opl3_state.h>
 #include <retrowave/direct_mode.h>
 #include <retrowave/voice_allocator.h>
 #include <retrowave/midi_router.h>
+#include <retrowave/midi_queue.h>
+#include <retrowave/midi_clock.h>
+#include <retrowave/latency_histogram.h>
+#include <retrowave/adl_realtime.h>
+#include <retrowave/adl_chip.h>
 
 #include <RtMidi.h>
 #include <adlmidi.h>
 #include <adlmidi_midiplay.hpp>
 #include <adlmidi_opl3.hpp>
-#include <chips/opl_chip_base.h>
-#include <midi_sequencer.hpp>
 
 class Daemon {
 public:
@@ -41,7 +47,11 @@ public:
 	~Daemon();
 
 	// Configuration (set before run())
-	void set_serial_port(const std::string &port) { serial_port_name_ = port; }
+
+	// Add a RetroWave card. In bank mode each card is one libADLMIDI chip;
+	// in direct mode the cards' channels form one VoiceAllocator channel
+	// space (card * 18 + channel). Returns false past VoiceAllocator::kMaxCards.
+	bool add_serial_port(const std::string &port);
 	void set_midi_port(int port) { midi_port_ = port; }
 	void set_midi_virtual(bool v) { midi_virtual_ = v; }
 	void set_mode(retrowave::RoutingMode mode) { router_.set_mode(mode); }
@@ -49,11 +59,26 @@ public:
 	void set_bank_path(const std::string &path) { bank_path_ = path; }
 	void set_volume_model(int model) { volmodel_id_ = model; }
 
+	// Fixed MIDI latency: each event is played at its rtmidi timestamp plus
+	// this delay, so inter-onset timing survives scheduling jitter.
+	// 0 (default) plays events as soon as they are dequeued.
+	void set_latency_ms(double ms) { latency_ns_ = ms > 0 ? static_cast<int64_t>(ms * 1e6) : 0; }
+
+	// Bank-mode tick period (default 1ms).
+	void set_tick_ms(double ms) { if (ms > 0) tick_ns_ = static_cast<int64_t>(ms * 1e6); }
+
+	// Register writes per serial frame, 0 (default) for no limit. Patch
+	// loads and batch writes are never split across frames.
+	void set_max_frame_writes(size_t n) { max_frame_writes_ = n; }
+
 	// Run the main loop (blocks until should_stop_ is set)
 	int run();
 
-	// Signal the daemon to stop
-	void request_stop() { should_stop_ = true; }
+	// Signal the daemon to stop (async-signal-safe)
+	void request_stop();
+
+	// Ask the engine thread to print statistics (async-signal-safe)
+	void request_stats();
 
 	// List available devices
 	static void list_midi_ports();
@@ -61,22 +86,81 @@ public:
 	static void list_banks();
 
 private:
+	// One RetroWave card: its port, I/O thread, frame buffer, shadow and
+	// direct-mode translator.
+	// Each card has its own SerialWriter, so frames for different cards are
+	// written in parallel and a slow port only backs up its own ring.
+	struct Card {
+		std::string port_name;
+		retrowave::PosixSerialPort serial;
+		retrowave::SerialWriter writer{serial};
+		retrowave::OPL3HardwareBuffer hw{serial};
+		retrowave::OPL3State state{hw};
+		retrowave::DirectMode direct{state};
+
+		Card() { hw.set_writer(&writer); }
+	};
+
+	static std::vector<std::unique_ptr<Card>> make_cards();
+
+	bool init_engine();
 	bool init_serial();
 	bool init_midi();
 	bool init_adlmidi();
 	void cleanup();
+	void print_stats();
+
+	// SysEx responses (patch dumps, voice queries) to the MIDI output port.
+	void send_midi(const std::vector<uint8_t> &msg);
+
+	// Route one MIDI message to direct mode or libADLMIDI (engine thread).
+	void process_message(const uint8_t *data, size_t len);
+
+	// Engine thread sleep/wake (eventfd). wake() may be called from any thread.
+	void wait_for_wakeup(int64_t deadline_ns);
+	void wake();
+
+	// Bank-mode activity: held notes and sustain, to know when ticks are needed.
+	void track_activity(const uint8_t *data, size_t len);
+	bool bank_active(int64_t now) const;
+
+	// Bank-mode tick timer (timerfd), and advancing libADLMIDI to now.
+	void set_ticking(bool on, int64_t now);
+	void advance_bank(int64_t now);
 
 	static void midi_on_receive(double timeStamp, std::vector<unsigned char> *message, void *userData);
 	static void midi_on_error(RtMidiError::Type type, const std::string &errorText, void *userData);
 
-	retrowave::PosixSerialPort serial_;
-	retrowave::OPL3HardwareBuffer hw_buf_{serial_};
-	retrowave::OPL3State opl3_state_{hw_buf_};
-	retrowave::DirectMode direct_mode_{opl3_state_};
-	retrowave::VoiceAllocator voice_alloc_{direct_mode_, opl3_state_};
+	std::vector<std::unique_ptr<Card>> cards_ = make_cards(); // never empty
+	retrowave::VoiceAllocator voice_alloc_{cards_.front()->direct, cards_.front()->state};
 	retrowave::MidiRouter router_;
 
-	std::string serial_port_name_;
+	// rtmidi callback -> engine thread (run loop)
+	retrowave::MidiQueue midi_queue_;
+	retrowave::MidiTimestamper midi_clock_; // rtmidi thread only
+	retrowave::LatencyHistogram jitter_;    // engine thread only
+	int64_t latency_ns_ = 0;
+	size_t max_frame_writes_ = 0;
+
+	int wake_fd_ = -1;
+	std::bitset<16 * 128> held_keys_;
+	uint16_t sustain_mask_ = 0;
+	int64_t last_midi_ns_ = 0;
+	int64_t run_start_ns_ = 0;
+	uint64_t wakeups_ = 0;
+	uint64_t idle_wakeups_ = 0;
+
+	int timer_fd_ = -1;
+	bool timer_armed_ = false;
+	int64_t tick_ns_ = 1000000;
+	int64_t timer_first_ns_ = 0;   // first expiry since armed
+	uint64_t tick_index_ = 0;      // expiries since armed
+	uint64_t ticks_due_ = 0;       // expiries not yet applied
+	uint64_t tick_overruns_ = 0;   // expiries missed by a late wakeup
+	int64_t last_advance_ns_ = 0;  // when libADLMIDI was last advanced
+	retrowave::LatencyHistogram tick_jitter_;
+	std::atomic<bool> stats_requested_{false};
+
 	int midi_port_ = -1;
 	bool midi_virtual_ = true;
 
@@ -87,7 +171,6 @@ private:
 	RtMidiIn *midiin_ = nullptr;
 	RtMidiOut *midiout_ = nullptr;
 	ADL_MIDIPlayer *adl_midi_player_ = nullptr;
-	MidiSequencer *adl_midi_sequencer_ = nullptr;
 
 	std::atomic<bool> should_stop_{false};
 };
@@ -36,6 +36,12 @@ static void signal_handler(int sig)
 		g_daemon->request_stop();
 }
 
+static void stats_signal_handler(int sig)
+{
+	if (g_daemon)
+		g_daemon->request_stats();
+}
+
 static void daemonize(const char *pid_file)
 {
 	pid_t pid = fork();
@@ -85,12 +91,19 @@ static void print_usage(const char *argv0)
 		"Usage: %s [options]\n"
 		"\n"
 		"Options:\n"
-		"  -s, --serial PORT     Serial port device (e.g. /dev/ttyUSB0)\n"
+		"  -s, --serial PORT     Serial port device (e.g. /dev/ttyUSB0); repeat to\n"
+		"                        drive several cards (up to 7; bank mode: one chip\n"
+		"                        each, direct mode: channels card*18 + 0-17)\n"
 		"  -m, --midi PORT       MIDI input port number, or 'virtual' (default: virtual)\n"
 		"  -M, --mode MODE       Mode: 'bank' or 'direct' (default: bank)\n"
 		"  -b, --bank ID         Bank number (default: 58)\n"
 		"  -B, --bank-file PATH  Bank file path (WOPL format)\n"
 		"  -v, --volume-model N  Volume model (0-11, default: 0/AUTO)\n"
+		"  -l, --latency MS      Fixed MIDI latency in ms; preserves event timing\n"
+		"                        at the cost of a constant delay (default: 0/off)\n"
+		"  -t, --tick MS         Bank-mode tick period in ms (default: 1)\n"
+		"  -F, --max-frame N     Register writes per serial frame; patch loads are\n"
+		"                        never split (default: 0/no limit)\n"
 		"  -D, --daemon          Run as daemon (background)\n"
 		"  -P, --pid-file PATH   PID file path (with --daemon)\n"
 		"      --list-midi       List available MIDI ports\n"
@@ -98,11 +111,14 @@ static void print_usage(const char *argv0)
 		"      --list-banks      List available banks\n"
 		"  -h, --help            Show this help\n"
 		"\n"
+		"Send SIGUSR1 to print timing and throughput statistics.\n"
+		"\n"
 		"Examples:\n"
 		"  %s -s /dev/ttyUSB0 -m virtual -M bank -b 58\n"
+		"  %s -s /dev/ttyUSB0 -s /dev/ttyUSB1 -M bank\n"
 		"  %s -s /dev/ttyUSB0 -m 1 -M direct\n"
 		"  %s -s /dev/ttyUSB0 --daemon -P /run/retrowave-midi.pid\n",
-		argv0, argv0, argv0, argv0);
+		argv0, argv0, argv0, argv0, argv0);
 }
 
 enum LongOpts {
@@ -120,6 +136,9 @@ int main(int argc, char *argv[])
 		{"bank",         required_argument, nullptr, 'b'},
 		{"bank-file",    required_argument, nullptr, 'B'},
 		{"volume-model", required_argument, nullptr, 'v'},
+		{"latency",      required_argument, nullptr, 'l'},
+		{"tick",         required_argument, nullptr, 't'},
+		{"max-frame",    required_argument, nullptr, 'F'},
 		{"daemon",       no_argument,       nullptr, 'D'},
 		{"pid-file",     required_argument, nullptr, 'P'},
 		{"list-midi",    no_argument,       nullptr, OPT_LIST_MIDI},
@@ -134,10 +153,14 @@ int main(int argc, char *argv[])
 	const char *pid_file = nullptr;
 
 	int opt;
-	while ((opt = getopt_long(argc, argv, "s:m:M:b:B:v:DP:h", long_options, nullptr)) != -1) {
+	while ((opt = getopt_long(argc, argv, "s:m:M:b:B:v:l:t:F:DP:h", long_options, nullptr)) != -1) {
 		switch (opt) {
 		case 's':
-			daemon.set_serial_port(optarg);
+			if (!daemon.add_serial_port(optarg)) {
+				fprintf(stderr, "Error: too many serial ports (max %d)\n",
+				        retrowave::VoiceAllocator::kMaxCards);
+				return 1;
+			}
 			break;
 		case 'm':
 			if (strcmp(optarg, "virtual") == 0) {
@@ -162,6 +185,15 @@ int main(int argc, char *argv[])
 		case 'v':
 			daemon.set_volume_model(atoi(optarg));
 			break;
+		case 'l':
+			daemon.set_latency_ms(atof(optarg));
+			break;
+		case 't':
+			daemon.set_tick_ms(atof(optarg));
+			break;
+		case 'F':
+			daemon.set_max_frame_writes(strtoul(optarg, nullptr, 10));
+			break;
 		case 'D':
 			do_daemon = true;
 			break;
@@ -190,6 +222,7 @@ int main(int argc, char *argv[])
 	g_daemon = &daemon;
 	signal(SIGINT, signal_handler);
 	signal(SIGTERM, signal_handler);
+	signal(SIGUSR1, stats_signal_handler);
 
 	return daemon.run();
 }
@@ -0,0 +1,60 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Header-only: retrowave_core does not link libADLMIDI, the frontends do.
+
+#include <cstdint>
+
+#include <chips/opl_chip_base.h>
+
+#include <retrowave/opl3_state.h>
+
+namespace retrowave {
+
+// libADLMIDI chip that drives a RetroWave card. Register writes go through
+// the OPL3State shadow, so bank mode gets the same redundant-write elision
+// and coalescing as direct mode, and the shadow reflects the card.
+//
+// Install it in place of the emulated chip (needs -Dprivate=public):
+//   synth->m_chips[i].reset(new RetroWaveADLChip(state));
+class RetroWaveADLChip final : public OPLChipBaseT<RetroWaveADLChip> {
+public:
+	explicit RetroWaveADLChip(OPL3State &state) : state_(state)
+	{
+		// Init sequence and a clean, fully known shadow
+		state_.reset();
+	}
+
+	bool canRunAtPcmRate() const override { return true; }
+
+	void writeReg(uint16_t addr, uint8_t data) override { state_.write(addr, data); }
+
+	void nativePreGenerate() override {}
+	void nativePostGenerate() override {}
+	void nativeGenerate(int16_t *) override {}
+	const char *emulatorName() override { return "RetroWave"; }
+	ChipType chipType() override { return CHIPTYPE_OPL3; }
+
+	OPL3State &state() { return state_; }
+
+private:
+	OPL3State &state_;
+};
+
+} // namespace retrowave
@@ -0,0 +1,89 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Header-only: retrowave_core does not link libADLMIDI, the frontends do.
+
+#include <cstddef>
+#include <cstdint>
+
+#include <adlmidi.h>
+
+namespace retrowave {
+
+// Dispatch one complete raw MIDI message to libADLMIDI's real-time API.
+// Nothing is allocated per event. Returns false for messages libADLMIDI
+// has no real-time entry point for (system common/real-time, truncated).
+inline bool adl_rt_dispatch(ADL_MIDIPlayer *player, const uint8_t *data, size_t len)
+{
+	if (len == 0)
+		return false;
+
+	uint8_t status = data[0];
+	if (status == 0xF0) {
+		adl_rt_systemExclusive(player, data, len);
+		return true;
+	}
+	if (status == 0xFF) { // System reset
+		adl_rt_resetState(player);
+		return true;
+	}
+	if (status < 0x80 || status > 0xEF)
+		return false;
+
+	uint8_t ch = status & 0x0F;
+	switch (status & 0xF0) {
+	case 0xC0: // Program change
+		if (len < 2) return false;
+		adl_rt_patchChange(player, ch, data[1]);
+		return true;
+	case 0xD0: // Channel pressure
+		if (len < 2) return false;
+		adl_rt_channelAfterTouch(player, ch, data[1]);
+		return true;
+	default:
+		break;
+	}
+
+	if (len < 3)
+		return false;
+
+	switch (status & 0xF0) {
+	case 0x80:
+		adl_rt_noteOff(player, ch, data[1]);
+		break;
+	case 0x90:
+		if (data[2] == 0)
+			adl_rt_noteOff(player, ch, data[1]);
+		else
+			adl_rt_noteOn(player, ch, data[1], data[2]);
+		break;
+	case 0xA0:
+		adl_rt_noteAfterTouch(player, ch, data[1], data[2]);
+		break;
+	case 0xB0:
+		adl_rt_controllerChange(player, ch, data[1], data[2]);
+		break;
+	case 0xE0:
+		adl_rt_pitchBendML(player, ch, data[2], data[1]);
+		break;
+	}
+	return true;
+}
+
+} // namespace retrowave
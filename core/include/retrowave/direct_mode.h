@@ -42,6 +42,13 @@ static constexpr uint8_t kSysExVoiceConfig  = 0x30;
 static constexpr uint8_t kSysExVoiceQuery  = 0x31;
 static constexpr uint8_t kSysExHWReset     = 0x7F;
 
+// How note-on velocity maps to carrier attenuation.
+enum class VelocityCurve : uint8_t {
+	Linear,      // attenuation linear in velocity (0.75 dB per 2 steps)
+	ADL,         // amplitude proportional to velocity, as libADLMIDI's volume model
+	Exponential, // amplitude proportional to velocity squared
+};
+
 // Direct OPL3 control mode. Translates MIDI note on/off, CCs, NRPNs,
 // and SysEx messages into OPL3 register writes.
 class DirectMode {
@@ -84,6 +91,10 @@ public:
 	// Initialize OPL3 to a clean state for direct mode.
 	void init();
 
+	// Select the velocity curve for subsequent note-ons (kept across init).
+	void set_velocity_curve(VelocityCurve curve) { velocity_curve_ = curve; }
+	VelocityCurve velocity_curve() const { return velocity_curve_; }
+
 	// --- Per-OPL3-channel methods (used by VoiceAllocator) ---
 
 	// Play a note on a specific OPL3 channel index (0-17).
@@ -98,6 +109,10 @@ public:
 	// Apply a CC value to a specific OPL3 channel.
 	void apply_cc_to_channel(uint8_t opl3_ch, uint8_t cc, uint8_t val);
 
+	// Apply a CC value to a set of OPL3 channels (bit n = channel n, 0-17).
+	// The derived register value is computed once where it is shared.
+	void apply_cc_to_channels(uint32_t mask, uint8_t cc, uint8_t val);
+
 	// --- Percussion methods (used by VoiceAllocator) ---
 
 	enum Drum : uint8_t { kBD = 0, kSD = 1, kTT = 2, kCY = 3, kHH = 4, kNumDrums = 5 };
@@ -153,21 +168,34 @@ private:
 	void sysex_reset_all();
 	void sysex_hw_reset();
 
+	// OPL3 pan bits (C0 bits 4-5) for a CC10 value.
+	static uint8_t pan_bits(uint8_t val);
+
 	// Update output level for a channel's carrier, combining volume + expression.
 	void update_carrier_level(uint8_t ch);
 
+	// Write a channel's carrier level from a volume/expression attenuation,
+	// adding velocity if a note is playing.
+	void write_carrier_level(uint8_t ch, uint8_t base_atten);
+
 	// Update output level for a channel's modulator, combining mod wheel + brightness.
 	void update_modulator_level(uint8_t ch);
 
 	// Compute OPL3 attenuation (0-63) from MIDI volume (0-127) and expression (0-127).
 	static uint8_t compute_attenuation(uint8_t volume, uint8_t expression);
 
-	// Write frequency registers for a channel.
-	void write_freq(uint8_t ch, uint16_t f_num, uint8_t block, bool key_on);
+	// Attenuation (0-63) added for a note-on velocity under the current curve.
+	uint8_t velocity_attenuation(uint8_t vel) const;
+
+	// Write frequency registers for a channel. retrigger forces the B0 write
+	// out even if it matches the shadow (note-on must always reach the chip).
+	void write_freq(uint8_t ch, uint16_t f_num, uint8_t block, bool key_on,
+	                bool retrigger = false);
 
 	OPL3State &state_;
 	uint8_t device_id_;
 	MidiOutputFn midi_output_;
+	VelocityCurve velocity_curve_ = VelocityCurve::Linear;
 
 	ChannelState channels_[18];
 };
@@ -0,0 +1,66 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace retrowave {
+
+// Fixed-size log-linear histogram of nanosecond durations (16 sub-buckets
+// per power of two, so percentiles are within ~6%). Recording never
+// allocates. Not thread-safe.
+class LatencyHistogram {
+public:
+	LatencyHistogram();
+
+	// Record one sample. Negative samples (event handled before its
+	// deadline) are counted as early and recorded as 0.
+	void record(int64_t ns);
+
+	void clear();
+
+	uint64_t count() const { return count_; }
+	uint64_t early() const { return early_; }
+	int64_t min() const { return count_ ? min_ : 0; }
+	int64_t max() const { return count_ ? max_ : 0; }
+	double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0.0; }
+
+	// Value at quantile p (0.0-1.0), rounded down to its bucket.
+	int64_t percentile(double p) const;
+
+	// One-line summary in microseconds, e.g. for log output.
+	std::string summary() const;
+
+private:
+	static constexpr int kSubBits = 4;
+	static constexpr int kBuckets = (64 - kSubBits + 1) << kSubBits;
+
+	static int bucket(uint64_t v);
+	static uint64_t bucket_floor(int b);
+
+	uint64_t buckets_[kBuckets];
+	uint64_t count_ = 0;
+	uint64_t early_ = 0;
+	int64_t min_ = 0;
+	int64_t max_ = 0;
+	int64_t sum_ = 0;
+};
+
+} // namespace retrowave
@@ -0,0 +1,52 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace retrowave {
+
+// Monotonic time in nanoseconds (std::chrono::steady_clock).
+int64_t monotonic_ns();
+
+// Turns rtmidi's per-message delta timestamps into absolute monotonic
+// times. The deltas are summed from an anchor taken at the first message,
+// which keeps the driver's inter-onset timing instead of our (jittery)
+// callback arrival time. If the sum drifts from the arrival clock by more
+// than max_drift_ns, or lands in the future, it is re-anchored to arrival.
+// Called from the MIDI callback thread only.
+class MidiTimestamper {
+public:
+	static constexpr int64_t kDefaultMaxDriftNs = 20000000; // 20ms
+
+	explicit MidiTimestamper(int64_t max_drift_ns = kDefaultMaxDriftNs)
+		: max_drift_ns_(max_drift_ns) {}
+
+	// delta_sec: rtmidi timeStamp; now_ns: arrival time (monotonic_ns()).
+	int64_t stamp(double delta_sec, int64_t now_ns);
+
+	uint64_t reanchors() const { return reanchors_; }
+
+private:
+	int64_t max_drift_ns_;
+	int64_t last_ns_ = 0;
+	bool anchored_ = false;
+	uint64_t reanchors_ = 0;
+};
+
+} // namespace retrowave
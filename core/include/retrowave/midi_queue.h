@@ -0,0 +1,132 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace retrowave {
+
+// Lock-free single-producer/single-consumer queue of raw MIDI messages.
+// The rtmidi callback pushes and returns immediately; the engine thread
+// drains the queue and is the only thread that touches the OPL3 chain.
+// Messages up to kMaxMessage bytes are stored inline in a slot; longer
+// ones (large SysEx) are copied to the heap and freed once drained. When
+// the queue is full a message is dropped and counted rather than blocking
+// the MIDI thread.
+class MidiQueue {
+public:
+	static constexpr size_t kDefaultSlots = 256;
+	static constexpr size_t kSlotSize = 1024;
+	static constexpr size_t kMaxMessage = kSlotSize - 24;
+
+	struct Stats {
+		size_t depth = 0;            // messages currently queued
+		size_t max_depth = 0;        // high-water mark
+		size_t capacity = 0;
+		uint64_t pushed = 0;
+		uint64_t dropped_full = 0;   // queue was full
+		uint64_t oversize = 0;       // longer than kMaxMessage, copied to the heap
+		uint64_t dropped_oversize = 0; // oversize and the copy could not be allocated
+	};
+
+	// slots is rounded up to a power of two.
+	explicit MidiQueue(size_t slots = kDefaultSlots);
+
+	~MidiQueue();
+
+	MidiQueue(const MidiQueue &) = delete;
+	MidiQueue &operator=(const MidiQueue &) = delete;
+
+	// Producer side. time_ns is an opaque, non-decreasing timestamp (the
+	// engine uses monotonic_ns() times, see midi_clock.h).
+	// Returns false if the message was dropped.
+	bool push(const uint8_t *data, size_t len, int64_t time_ns = 0);
+
+	// Consumer side. Calls fn(data, len, time_ns) for each queued message,
+	// oldest first, up to max messages. Returns the number processed.
+	template <typename Fn>
+	size_t drain(Fn &&fn, size_t max = SIZE_MAX)
+	{
+		return drain_until(INT64_MAX, fn, max);
+	}
+
+	// As drain(), but stops at the first message stamped later than time_ns.
+	template <typename Fn>
+	size_t drain_until(int64_t time_ns, Fn &&fn, size_t max = SIZE_MAX)
+	{
+		size_t head = head_.load(std::memory_order_relaxed);
+		size_t tail = tail_.load(std::memory_order_acquire);
+		size_t n = 0;
+		while (head != tail && n < max) {
+			Slot &s = slots_[head & mask_];
+			if (s.time_ns > time_ns)
+				break;
+			fn(s.spill ? s.spill : s.data, static_cast<size_t>(s.len), s.time_ns);
+			release(s);
+			head_.store(++head, std::memory_order_release);
+			++n;
+		}
+		return n;
+	}
+
+	// Consumer side: timestamp of the oldest queued message, if any.
+	bool front_time(int64_t &time_ns) const;
+
+	// Consumer side: discard everything queued.
+	void clear();
+
+	bool empty() const
+	{
+		return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+	}
+
+	Stats stats() const;
+
+private:
+	struct Slot {
+		int64_t time_ns;
+		uint32_t len;
+		uint8_t *spill = nullptr; // heap copy of a message longer than kMaxMessage
+		uint8_t data[kMaxMessage];
+	};
+	static_assert(sizeof(Slot) <= kSlotSize, "MIDI queue slot too large");
+
+	static void release(Slot &s)
+	{
+		delete[] s.spill;
+		s.spill = nullptr;
+	}
+
+	std::vector<Slot> slots_;
+	size_t mask_;
+
+	// Monotonic indices: head_ = next message to drain, tail_ = next free slot.
+	alignas(64) std::atomic<size_t> head_{0};
+	alignas(64) std::atomic<size_t> tail_{0};
+
+	std::atomic<size_t> max_depth_{0};
+	std::atomic<uint64_t> pushed_{0};
+	std::atomic<uint64_t> dropped_full_{0};
+	std::atomic<uint64_t> oversize_{0};
+	std::atomic<uint64_t> dropped_oversize_{0};
+};
+
+} // namespace retrowave
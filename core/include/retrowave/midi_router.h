@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -31,7 +32,8 @@ enum class RoutingMode {
 };
 
 // Routes incoming MIDI messages to either bank mode (libADLMIDI) or direct mode.
-// In bank mode, the caller is responsible for forwarding to libADLMIDI's sequencer.
+// In bank mode, the caller is responsible for forwarding to libADLMIDI
+// (see adl_realtime.h).
 // In direct mode, this class delegates to DirectMode.
 class MidiRouter {
 public:
@@ -19,15 +19,31 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <mutex>
 #include <vector>
 
+#include <retrowave/protocol.h>
 #include <retrowave/serial_port.h>
 
 namespace retrowave {
 
+class SerialWriter;
+
 // Buffers OPL3 register writes and flushes them to serial as packed protocol frames.
-// Thread-safe: the mutex must be held by callers across queue/flush/reset sequences.
+// Not thread-safe: all calls come from the single engine thread that drains
+// the MidiQueue (see midi_queue.h).
+//
+// With coalescing enabled (the default), a register written several times
+// within one frame keeps a single pending command that is updated in place,
+// so only the last value goes out. Ordering the chip depends on is kept:
+// - a write that changes the key-on bit of B0-B8 or the 0xBD drum/rhythm
+//   bits is never merged, so key-off/key-on pairs both reach the chip;
+// - registers below 0x20 (0x104/0x105 mode, timers, test) and the board
+//   reset triggers are never merged and act as a barrier: later writes are
+//   not merged into commands queued before them.
+//
+// Writes queued between begin_batch() and end_batch() (e.g. a patch load)
+// always go out in the same frame, so the chip never plays a half-loaded
+// patch. With a frame bound, a batch start is also a barrier.
 class OPL3HardwareBuffer {
 public:
 	explicit OPL3HardwareBuffer(SerialPort &serial);
@@ -38,15 +54,60 @@ public:
 	// Queue a single OPL3 register write. addr bit 0x100 selects port A vs B.
 	void queue(uint16_t addr, uint8_t data);
 
-	// Pack and flush the buffer contents to serial, then reset.
+	void set_coalescing(bool enabled) { coalesce_ = enabled; }
+	bool coalescing() const { return coalesce_; }
+
+	// Number of writes merged into an already pending command.
+	uint64_t coalesced_writes() const { return coalesced_writes_; }
+
+	// True if no register writes are queued.
+	bool empty() const;
+
+	// Bound frames to max_writes register writes (0 = unbounded, the
+	// default): queue() flushes a full frame before adding to it. An open
+	// batch is never split; it moves whole into the next frame, or grows
+	// past the bound if it is larger on its own.
+	void set_max_frame_writes(size_t max_writes) { max_writes_ = max_writes; }
+	size_t max_frame_writes() const { return max_writes_; }
+
+	// Keep the writes queued until the matching end_batch() in one frame.
+	// Batches nest; flush() inside one is deferred to the outermost end.
+	void begin_batch();
+	void end_batch();
+
+	// Finish the packed frame and flush it to serial, then reset. If a
+	// SerialWriter is attached, the frame is handed to its I/O thread
+	// instead of being written from the calling thread. Does nothing if
+	// the buffer is empty, so polling callers never send header-only frames.
 	void flush();
 
-	std::mutex &mutex() { return mutex_; }
+	// Attach (or detach with nullptr) a SerialWriter for asynchronous output.
+	void set_writer(SerialWriter *writer) { writer_ = writer; }
 
 private:
+	// Finish the frame and hand it to the writer or serial port.
+	void send();
+
+	// Make room for a write in a full frame (see set_max_frame_writes()).
+	void make_room();
+
 	SerialPort &serial_;
-	std::vector<uint8_t> buf_;
-	std::mutex mutex_;
+	SerialWriter *writer_ = nullptr;
+	ProtocolPacker packer_; // raw commands, packed as they are queued
+
+	// Raw offset into the ProtocolPacker stream of the pending command for
+	// each register, or kNoPending.
+	static constexpr uint32_t kNoPending = 0xFFFFFFFF;
+	uint32_t pending_[512];
+	size_t barrier_ = 0; // commands before this raw offset are never merged into
+	bool coalesce_ = true;
+	uint64_t coalesced_writes_ = 0;
+
+	size_t max_writes_ = 0;
+	int batch_depth_ = 0;
+	size_t batch_start_ = 0;      // raw offset of the open batch's first command
+	bool flush_deferred_ = false; // flush() was called inside a batch
+	std::vector<uint8_t> carry_;  // batch commands moved to the next frame
 };
 
 } // namespace retrowave
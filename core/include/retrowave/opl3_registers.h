@@ -80,21 +80,30 @@ static constexpr uint8_t kFourOpEnableBit[6] = {
 	0x08, 0x10, 0x20, // port 1
 };
 
+// 4-op partner of each global OPL3 channel index (0-17), or -1 if the
+// channel is not pairable (6-8, 15-17).
+// 0↔3, 1↔4, 2↔5, 9↔12, 10↔13, 11↔14.
+static constexpr int8_t kFourOpPartner[18] = {
+	3, 4, 5,     // 0→3, 1→4, 2→5
+	0, 1, 2,     // 3→0, 4→1, 5→2
+	-1, -1, -1,  // 6,7,8 not pairable
+	12, 13, 14,  // 9→12, 10→13, 11→14
+	9, 10, 11,   // 12→9, 13→10, 14→11
+	-1, -1, -1,  // 15,16,17 not pairable
+};
+
 // Returns the 4-op partner of a global OPL3 channel index (0-17).
 // Returns -1 if the channel is not pairable (6-8, 15-17).
-// 0↔3, 1↔4, 2↔5, 9↔12, 10↔13, 11↔14.
-inline int four_op_partner(int ch)
+constexpr int four_op_partner(int ch)
 {
-	static constexpr int kPartners[18] = {
-		3, 4, 5,     // 0→3, 1→4, 2→5
-		0, 1, 2,     // 3→0, 4→1, 5→2
-		-1, -1, -1,  // 6,7,8 not pairable
-		12, 13, 14,  // 9→12, 10→13, 11→14
-		9, 10, 11,   // 12→9, 13→10, 14→11
-		-1, -1, -1,  // 15,16,17 not pairable
-	};
-	if (ch < 0 || ch >= 18) return -1;
-	return kPartners[ch];
+	return ch < 0 || ch >= 18 ? -1 : kFourOpPartner[ch];
+}
+
+// Returns the 0x104 bit that enables 4-op for the pair a global OPL3
+// channel index (0-17) belongs to, from either side. 0 if not pairable.
+constexpr uint8_t four_op_enable_bit(int ch)
+{
+	return four_op_partner(ch) < 0 ? 0 : kFourOpEnableBit[(ch >= 9 ? 3 : 0) + ch % 9 % 3];
 }
 
 // MIDI note to OPL3 F-Number and Block.
@@ -109,6 +118,21 @@ struct NoteFreq {
 // Get precomputed frequency data for a MIDI note (0-127).
 const NoteFreq &note_freq(int midi_note);
 
+// Fixed-point pitch: MIDI note * kPitchSteps, so one unit is 1/128
+// semitone. Bend and detune are offsets added in these units.
+constexpr int kPitchSteps = 128;
+
+// F-Number and Block for a fixed-point pitch, from a one-octave table.
+// Pitches below note 0 clamp to note 0.
+NoteFreq pitch_freq(int32_t pitch);
+
+// Pitch bend (0-16383, center 8192) as a pitch offset for a bend range
+// of semitones + cents, rounded to the nearest unit.
+int32_t bend_pitch(uint16_t bend, uint8_t range_semitones, uint8_t range_cents);
+
+// A pitch offset in cents, rounded to the nearest unit.
+int32_t cents_pitch(double cents);
+
 // Map channel index to OPL3 channel and port.
 // Indices 0-8:  port 0, channels 0-8
 // Indices 9-17: port 1, channels 0-8
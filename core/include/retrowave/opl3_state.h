@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 
@@ -27,6 +28,10 @@ namespace retrowave {
 // Shadow register file for the OPL3. Tracks all written values so we can
 // do read-modify-write for bitfield operations (OPL3 is write-only).
 // 256 registers per port, 2 ports = 512 bytes.
+//
+// With write elision enabled (the default), a write whose value matches the
+// shadow is dropped, but only if the register is "known", i.e. has been sent
+// to the hardware since the last reset()/invalidate().
 class OPL3State {
 public:
 	explicit OPL3State(OPL3HardwareBuffer &hw);
@@ -34,18 +39,57 @@ public:
 	// Read the shadow value (does not access hardware).
 	uint8_t read(uint16_t addr) const;
 
-	// Write a value and send to hardware.
+	// Write a value and send to hardware (skipped if redundant, see above).
 	void write(uint16_t addr, uint8_t data);
 
+	// Write a value and always send it, even if it matches the shadow.
+	// Used for key-on writes so retriggers always reach the chip.
+	void write_force(uint16_t addr, uint8_t data);
+
 	// Modify specific bits: clears bits in mask, then ORs in (value & mask).
 	void modify_bits(uint16_t addr, uint8_t mask, uint8_t value);
 
-	// Reset all shadow registers to 0 and send OPL3 init sequence.
+	// Reset all shadow registers and send OPL3 init sequence.
 	void reset();
 
+	// Mark every register unknown (e.g. after the device was reconnected),
+	// so the next write to each one is sent regardless of the shadow.
+	void invalidate();
+
+	void set_write_elision(bool enabled) { elide_ = enabled; }
+	bool write_elision() const { return elide_; }
+
+	// Number of writes dropped by write elision.
+	uint64_t elided_writes() const { return elided_writes_; }
+
+	// Send the writes until commit() to the chip together, in one frame
+	// (see OPL3HardwareBuffer::begin_batch()). Batches nest.
+	void begin_batch() { hw_.begin_batch(); }
+	void commit() { hw_.end_batch(); }
+
+	// Scoped batch: begin_batch() on construction, commit() on destruction.
+	class Batch {
+	public:
+		explicit Batch(OPL3State &state) : state_(state) { state_.begin_batch(); }
+		~Batch() { state_.commit(); }
+
+		Batch(const Batch &) = delete;
+		Batch &operator=(const Batch &) = delete;
+
+	private:
+		OPL3State &state_;
+	};
+
 private:
+	static size_t index(uint16_t addr) { return ((addr & 0x100) ? 256 : 0) + (addr & 0xFF); }
+
+	bool is_known(size_t idx) const { return (known_[idx >> 6] >> (idx & 63)) & 1; }
+
 	OPL3HardwareBuffer &hw_;
 	uint8_t regs_[512]; // [0..255] = port 0, [256..511] = port 1
+	uint64_t known_[8]; // 1 bit per register in regs_
+	bool elide_ = true;
+	uint64_t elided_writes_ = 0;
 };
 
 } // namespace retrowave
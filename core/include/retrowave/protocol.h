@@ -21,12 +21,106 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <vector>
 
 namespace retrowave {
 
 // Encodes raw bytes into the RetroWave serial wire protocol.
 // buf_out must be at least (len_in * 2 + 8) bytes.
 // Returns the number of bytes written to buf_out.
+//
+// The input is treated as a big-endian bit stream cut into 7-bit groups;
+// each group is sent as (group << 1) | 1, framed by 0x00 and 0x02. Every
+// 7 input bytes become exactly 8 output bytes, which this packs a block at
+// a time using 64-bit shifts (or BMI2 PDEP where available).
 size_t protocol_serial_pack(const uint8_t *buf_in, size_t len_in, uint8_t *buf_out);
 
+// Original byte-at-a-time implementation. Produces identical output; kept
+// as the reference for verification and benchmarking.
+size_t protocol_serial_pack_ref(const uint8_t *buf_in, size_t len_in, uint8_t *buf_out);
+
+// Decodes one packed frame (0x00 ... 0x02, as produced by
+// protocol_serial_pack) back into raw bytes, appended to out.
+// Returns false if the frame is malformed.
+bool protocol_serial_unpack(const uint8_t *buf_in, size_t len_in, std::vector<uint8_t> &out);
+
+// Incremental decoder for a serial byte stream carrying any number of
+// frames, possibly split across reads. Bytes outside a frame are skipped.
+class ProtocolDecoder {
+public:
+	using FrameFn = std::function<void(const uint8_t *raw, size_t len)>;
+
+	// Decode bytes; fn is called with the raw contents of each complete frame.
+	void feed(const uint8_t *data, size_t len, const FrameFn &fn);
+
+	// Discard any partially received frame.
+	void reset();
+
+	// Frames that contained a byte that is not a valid 7-bit group.
+	uint64_t malformed_frames() const { return malformed_; }
+
+private:
+	std::vector<uint8_t> raw_;
+	bool in_frame_ = false;
+	bool bad_ = false;
+	uint32_t acc_ = 0;   // bit accumulator
+	unsigned bits_ = 0;  // valid bits in acc_
+	uint64_t malformed_ = 0;
+};
+
+// One OPL3 register write recovered from a raw command stream.
+struct OPL3RegWrite {
+	uint16_t addr;  // bit 0x100 selects port 1
+	uint8_t value;
+
+	uint8_t port() const { return static_cast<uint8_t>(addr >> 8); }
+	uint8_t reg() const { return static_cast<uint8_t>(addr & 0xFF); }
+};
+
+// Parses the raw (unpacked) command stream built by OPL3HardwareBuffer:
+// a 2-byte header followed by 6-byte register write commands
+// (0xe1/0xe5 addr, 0xe3/0xe7 data, 0xfb data). Writes are appended to out.
+// Returns false if the header or a command is malformed.
+bool protocol_parse_opl3(const uint8_t *raw, size_t len, std::vector<OPL3RegWrite> &out);
+
+// Incremental form of protocol_serial_pack(). Raw bytes are packed into a
+// preallocated output arena as soon as each 7-byte block is complete, so
+// finishing a frame only packs the partial tail and appends the trailer.
+// The output of finish() is identical to protocol_serial_pack() over all
+// appended bytes (including any later update()s).
+class ProtocolPacker {
+public:
+	explicit ProtocolPacker(size_t reserve_raw = 512);
+
+	// Start a new frame.
+	void reset();
+
+	// Append raw bytes to the frame.
+	void append(const uint8_t *data, size_t len);
+
+	// Overwrite a raw byte that was already appended; repacks its block
+	// if that block has already been packed.
+	void update(size_t raw_offset, uint8_t value);
+
+	// Drop raw bytes from raw_len on (raw_len <= raw().size()).
+	void truncate(size_t raw_len);
+
+	// Pack the partial tail and the trailer. Returns the packed length;
+	// the frame is available from data() until the next reset()/append().
+	size_t finish();
+
+	const uint8_t *data() const { return out_.data(); }
+
+	// Raw (unpacked) bytes appended since reset().
+	const std::vector<uint8_t> &raw() const { return raw_; }
+
+private:
+	void ensure_out(size_t raw_len);
+
+	std::vector<uint8_t> raw_;
+	std::vector<uint8_t> out_; // arena; only grows
+	size_t sealed_ = 0;        // raw bytes already packed as full blocks
+};
+
 } // namespace retrowave
@@ -0,0 +1,109 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <retrowave/protocol.h>
+#include <retrowave/serial_port.h>
+
+namespace retrowave {
+
+// SerialPort that stands in for a RetroWave card. Incoming frames are
+// decoded into an OPL3 register image and a timestamped write log, so the
+// whole engine can be driven and checked without hardware.
+//
+// The link can optionally be modelled with a throughput limit and a fixed
+// latency. In Virtual timing, write() returns immediately and only the log
+// timestamps reflect the model; in Realtime timing, write() blocks until the
+// frame would have been transmitted, like a blocking tty write.
+class LoopbackSerialPort : public SerialPort {
+public:
+	enum class Timing { Virtual, Realtime };
+
+	struct LogEntry {
+		uint64_t time_ns; // arrival at the chip, relative to open()
+		uint16_t addr;
+		uint8_t value;
+	};
+
+	struct Stats {
+		uint64_t frames = 0;
+		uint64_t bytes = 0;           // packed bytes received
+		uint64_t writes = 0;          // register writes decoded
+		uint64_t malformed_frames = 0;
+		uint64_t link_busy_ns = 0;    // modelled transmission time
+	};
+
+	LoopbackSerialPort() = default;
+
+	LoopbackSerialPort(const LoopbackSerialPort &) = delete;
+	LoopbackSerialPort &operator=(const LoopbackSerialPort &) = delete;
+
+	bool open(const std::string &port_name) override;
+	void close() override;
+	bool is_open() const override;
+	bool write(const uint8_t *data, size_t len) override;
+
+	// --- Link model ---
+
+	// Throughput in bytes per second; 0 = unlimited.
+	void set_bandwidth(uint64_t bytes_per_sec);
+	// Fixed delay added to every frame's arrival time.
+	void set_latency(std::chrono::nanoseconds latency);
+	void set_timing(Timing timing);
+
+	// Keep the per-write log (on by default). Disable for long benchmarks.
+	void set_logging(bool enabled);
+
+	// --- Inspection ---
+
+	uint8_t reg(uint16_t addr) const;
+	std::vector<uint8_t> registers() const;     // 512-entry image
+	std::vector<LogEntry> log() const;
+	Stats stats() const;
+
+	// Clear the register image, log and statistics.
+	void reset();
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	uint64_t now_ns() const;
+
+	mutable std::mutex mutex_;
+	bool open_ = false;
+	clock::time_point epoch_ = clock::now();
+
+	uint64_t bandwidth_ = 0;
+	uint64_t latency_ns_ = 0;
+	Timing timing_ = Timing::Virtual;
+	bool logging_ = true;
+	uint64_t link_free_ns_ = 0;
+
+	ProtocolDecoder decoder_;
+	std::vector<OPL3RegWrite> scratch_;
+	uint8_t regs_[512] = {};
+	std::vector<LogEntry> log_;
+	Stats stats_;
+};
+
+} // namespace retrowave
@@ -23,8 +23,8 @@
 
 namespace retrowave {
 
-// Abstract serial port interface. Implemented by QSerialPort wrapper (GUI)
-// and POSIX termios (CLI).
+// Abstract serial port interface. Implemented by QSerialPort wrapper (GUI),
+// POSIX termios (CLI) and an in-memory loopback (benchmarks).
 class SerialPort {
 public:
 	virtual ~SerialPort() = default;
@@ -0,0 +1,102 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <retrowave/serial_port.h>
+
+namespace retrowave {
+
+// Dedicated I/O thread that owns all writes to a SerialPort. Packed frames
+// are handed over through a bounded single-producer/single-consumer ring, so
+// the producer (OPL3HardwareBuffer::flush) never blocks in the kernel.
+// Only one thread may call submit() at a time.
+class SerialWriter {
+public:
+	static constexpr size_t kDefaultSlots = 64;
+
+	// A write() taking longer than this is counted as a slow write: under the
+	// old synchronous design it would have stalled the MIDI callback.
+	static constexpr uint64_t kSlowWriteNs = 1000000; // 1ms
+
+	struct Stats {
+		size_t occupancy = 0;        // frames currently queued
+		size_t max_occupancy = 0;    // high-water mark
+		size_t capacity = 0;
+		uint64_t frames = 0;         // frames written to the port
+		uint64_t bytes = 0;          // bytes written to the port
+		uint64_t ring_full_stalls = 0; // submit() had to wait for space
+		uint64_t slow_writes = 0;    // write() calls longer than kSlowWriteNs
+		uint64_t write_errors = 0;
+	};
+
+	// slots is rounded up to a power of two.
+	explicit SerialWriter(SerialPort &serial, size_t slots = kDefaultSlots);
+	~SerialWriter();
+
+	SerialWriter(const SerialWriter &) = delete;
+	SerialWriter &operator=(const SerialWriter &) = delete;
+
+	// Start the I/O thread. The serial port should already be open.
+	void start();
+
+	// Write out any queued frames, then stop the I/O thread.
+	void stop();
+
+	bool running() const { return running_.load(std::memory_order_acquire); }
+
+	// Copy a packed frame into the ring. If the ring is full, waits for the
+	// writer to free a slot (counted in ring_full_stalls).
+	void submit(const uint8_t *data, size_t len);
+
+	Stats stats() const;
+
+private:
+	void thread_main();
+
+	SerialPort &serial_;
+	std::vector<std::vector<uint8_t>> slots_;
+	size_t mask_;
+
+	// Monotonic indices: head_ = next slot to write out, tail_ = next free slot.
+	alignas(64) std::atomic<size_t> head_{0};
+	alignas(64) std::atomic<size_t> tail_{0};
+
+	std::thread thread_;
+	std::atomic<bool> running_{false};
+	std::atomic<bool> stop_{false};
+	std::atomic<bool> sleeping_{false};
+	std::mutex wake_mutex_;
+	std::condition_variable wake_cv_;
+
+	std::atomic<size_t> max_occupancy_{0};
+	std::atomic<uint64_t> frames_{0};
+	std::atomic<uint64_t> bytes_{0};
+	std::atomic<uint64_t> ring_full_stalls_{0};
+	std::atomic<uint64_t> slow_writes_{0};
+	std::atomic<uint64_t> write_errors_{0};
+};
+
+} // namespace retrowave
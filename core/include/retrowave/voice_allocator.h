@@ -22,28 +22,178 @@
 #include <vector>
 #include <array>
 #include <functional>
+#include <initializer_list>
 
 #include <retrowave/direct_mode.h>
 #include <retrowave/opl3_state.h>
 
 namespace retrowave {
 
+// Fixed-size set of global OPL3 channel indices (up to 128, i.e. 7 cards).
+// Used for voice pools and note groups so allocation never touches the heap.
+class VoiceMask {
+public:
+	static constexpr int kBits = 128;
+
+	void set(int i) { w_[i >> 6] |= bit(i); }
+	void reset(int i) { w_[i >> 6] &= ~bit(i); }
+	bool test(int i) const { return (w_[i >> 6] & bit(i)) != 0; }
+	void clear() { w_[0] = w_[1] = 0; }
+
+	bool any() const { return (w_[0] | w_[1]) != 0; }
+	bool none() const { return !any(); }
+	int count() const { return __builtin_popcountll(w_[0]) + __builtin_popcountll(w_[1]); }
+
+	// Lowest set index, or -1 if empty.
+	int first() const
+	{
+		if (w_[0])
+			return __builtin_ctzll(w_[0]);
+		if (w_[1])
+			return 64 + __builtin_ctzll(w_[1]);
+		return -1;
+	}
+
+	// Lowest set index above i, or -1.
+	int next(int i) const
+	{
+		if (++i >= kBits)
+			return -1;
+		int w = i >> 6;
+		uint64_t m = w_[w] & (~uint64_t(0) << (i & 63));
+		if (m)
+			return (w << 6) + __builtin_ctzll(m);
+		if (w == 0 && w_[1])
+			return 64 + __builtin_ctzll(w_[1]);
+		return -1;
+	}
+
+	// n (at most 32) bits starting at index lo, as a bitmask.
+	uint32_t bits(int lo, int n) const
+	{
+		int w = lo >> 6, s = lo & 63;
+		uint64_t v = w_[w] >> s;
+		if (w == 0 && s)
+			v |= w_[1] << (64 - s);
+		return static_cast<uint32_t>(v & ((uint64_t(1) << n) - 1));
+	}
+
+	// The lowest n set indices.
+	VoiceMask lowest(int n) const
+	{
+		VoiceMask out;
+		for (int i = first(); i >= 0 && n > 0; i = next(i), --n)
+			out.set(i);
+		return out;
+	}
+
+	VoiceMask operator&(const VoiceMask &o) const { return {w_[0] & o.w_[0], w_[1] & o.w_[1]}; }
+	VoiceMask operator|(const VoiceMask &o) const { return {w_[0] | o.w_[0], w_[1] | o.w_[1]}; }
+	VoiceMask operator~() const { return {~w_[0], ~w_[1]}; }
+	VoiceMask &operator&=(const VoiceMask &o) { w_[0] &= o.w_[0]; w_[1] &= o.w_[1]; return *this; }
+	VoiceMask &operator|=(const VoiceMask &o) { w_[0] |= o.w_[0]; w_[1] |= o.w_[1]; return *this; }
+	bool operator==(const VoiceMask &o) const { return w_[0] == o.w_[0] && w_[1] == o.w_[1]; }
+
+	VoiceMask() = default;
+
+private:
+	VoiceMask(uint64_t lo, uint64_t hi) : w_{lo, hi} {}
+	static uint64_t bit(int i) { return uint64_t(1) << (i & 63); }
+
+	uint64_t w_[2] = {0, 0};
+};
+
+// OPL3 channel indices in a fixed inline array, in the order given. Holds
+// one entry per channel VoiceAllocator can address (7 cards x 18); entries
+// past that are ignored.
+class ChannelList {
+public:
+	static constexpr size_t kCapacity = 7 * 18;
+
+	ChannelList() = default;
+	ChannelList(std::initializer_list<uint8_t> chs)
+	{
+		for (uint8_t ch : chs)
+			push_back(ch);
+	}
+
+	void push_back(uint8_t ch)
+	{
+		if (size_ < kCapacity)
+			ch_[size_++] = ch;
+	}
+
+	// Remove [first, last), keeping the order of the rest.
+	void erase(const uint8_t *first, const uint8_t *last)
+	{
+		uint8_t *out = ch_.data() + (first - ch_.data());
+		const uint8_t *in = last, *e = end();
+		while (in != e)
+			*out++ = *in++;
+		size_ = static_cast<uint8_t>(out - ch_.data());
+	}
+
+	void clear() { size_ = 0; }
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+	uint8_t operator[](size_t i) const { return ch_[i]; }
+
+	uint8_t *begin() { return ch_.data(); }
+	uint8_t *end() { return ch_.data() + size_; }
+	const uint8_t *begin() const { return ch_.data(); }
+	const uint8_t *end() const { return ch_.data() + size_; }
+
+private:
+	std::array<uint8_t, kCapacity> ch_ = {};
+	uint8_t size_ = 0;
+};
+
 struct VoiceConfig {
-	std::vector<uint8_t> opl3_channels; // assigned OPL3 ch indices (0-17)
+	ChannelList opl3_channels;          // assigned OPL3 ch indices (card * 18 + 0-17)
 	uint8_t unison_count = 1;           // 1=poly, N=unison, combined otherwise
 	uint8_t detune_cents = 10;          // spread for unison voices (0-100)
 	bool four_op = false;               // treat 4-op pairs as single voice slot
 	bool pan_split = false;             // unison stereo spread (L/R split)
 };
 
+// Per-MIDI-channel limits for the dynamic pool (see PoolMode).
+struct ChannelLimits {
+	uint8_t min_voices = 0;  // reserved: never stolen by, or lent to, other channels
+	uint8_t max_voices = 0;  // cap on sounding voices (0 = no cap)
+	uint8_t priority = 64;   // higher priority steals from lower (0-127)
+};
+
+// How OPL3 channels are shared between MIDI channels.
+enum class PoolMode : uint8_t {
+	Static,  // each MIDI channel plays on its VoiceConfig::opl3_channels
+	Dynamic, // all channels form one pool, shared under ChannelLimits
+};
+
 // Polyphonic voice allocator. Routes MIDI messages through DirectMode
 // per-channel methods with support for multi-voice polyphony, unison
 // detuning, and note stealing.
+//
+// Voice pools can span several cards: each card has its own DirectMode
+// (and OPL3State), and OPL3 channels are addressed by a global index
+// card * kChannelsPerCard + channel, card 0 being the one passed to the
+// constructor. Percussion and register-level SysEx use card 0.
 class VoiceAllocator {
 public:
+	static constexpr int kChannelsPerCard = 18;
+	static constexpr int kMaxCards = 7; // global indices must fit a SysEx data byte
+
 	// device_id: SysEx device ID for filtering (0x7F = all)
 	explicit VoiceAllocator(DirectMode &dm, OPL3State &state, uint8_t device_id = 0x7F);
 
+	// Add another card. Its channels get the next kChannelsPerCard global
+	// indices. Returns false if kMaxCards are already attached.
+	bool add_card(DirectMode &dm);
+
+	size_t card_count() const { return cards_.size(); }
+
+	// Number of addressable OPL3 channels (kChannelsPerCard per card).
+	int channel_count() const { return static_cast<int>(cards_.size()) * kChannelsPerCard; }
+
 	// Callback type for sending MIDI output (SysEx responses).
 	using MidiOutputFn = std::function<void(const std::vector<uint8_t> &)>;
 
@@ -60,7 +210,7 @@ public:
 	// Get current voice configuration for a MIDI channel.
 	const VoiceConfig &voice_config(uint8_t midi_ch) const;
 
-	// Initialize default 1:1 mapping: MIDI 0-15 → OPL3 0-15, unison=1.
+	// Initialize default 1:1 mapping: MIDI 0-15 → OPL3 0-15 (card 0), unison=1.
 	void init_default_mapping();
 
 	// Release all sounding notes and reset allocation state.
@@ -69,6 +219,22 @@ public:
 	// Get the number of poly voices available for a MIDI channel.
 	int poly_voice_count(uint8_t midi_ch) const;
 
+	// --- Dynamic pool ---
+
+	// In dynamic mode every OPL3 channel (except the percussion channels
+	// while percussion mode is on) is shared. A note takes free voices
+	// first, then steals the oldest group of the lowest-priority channel
+	// that may lose it (same or lower priority, still at or above its
+	// minimum afterwards; its own groups always qualify). Each MIDI
+	// channel's patch follows its voices: it is copied onto a channel
+	// taken over from another MIDI channel. 4-op mode is not supported.
+	// Switching modes releases all notes.
+	void set_pool_mode(PoolMode mode);
+	PoolMode pool_mode() const { return pool_mode_; }
+
+	void set_channel_limits(uint8_t midi_ch, const ChannelLimits &limits);
+	const ChannelLimits &channel_limits(uint8_t midi_ch) const;
+
 	// --- Percussion routing ---
 
 	// Enable/disable percussion mode (sets 0xBD bit 5).
@@ -83,21 +249,56 @@ public:
 	static constexpr uint8_t kSysExPercConfig = 0x32;
 	static constexpr uint8_t kSysExPercQuery = 0x33;
 
+	// SysEx commands for the dynamic pool
+	static constexpr uint8_t kSysExPoolConfig = 0x34;
+	static constexpr uint8_t kSysExPoolQuery = 0x35;
+
 private:
-	// Internal voice slot — tracks one OPL3 channel playing a note.
+	static constexpr int kMaxChannels = kMaxCards * kChannelsPerCard;
+	static_assert(ChannelList::kCapacity == kMaxChannels, "ChannelList must hold every channel");
+	static constexpr int8_t kNone = -1;
+
+	// Patch registers of a 2-op channel: 20/40/60/80/E0 of both operators, C0.
+	static constexpr int kPatchRegs = 11;
+
+	// Internal voice slot — tracks one OPL3 channel playing a note. Indexed
+	// by global OPL3 channel; the MIDI channel whose pool holds it owns it.
+	//
+	// The voices started by one note-on form a group. Its leader (lowest
+	// channel) holds the group mask and the links of the owning MIDI
+	// channel's LRU list of groups, oldest first, so stealing is O(1).
 	struct Voice {
 		int8_t note = -1;        // MIDI note (-1 = free)
 		uint8_t velocity = 0;
-		uint64_t timestamp = 0;  // monotonic, for LRU stealing
 		uint16_t detuned_fnum = 0;
 		uint8_t detuned_block = 0;
-		bool sustained = false;  // held by sustain pedal
+		uint8_t unison_idx = 0;    // position within its note group
+		int16_t detune = 0;        // unison detune in opl3::kPitchSteps units
+		uint8_t leader = 0;      // group leader channel
+		uint8_t owner = 0;       // MIDI channel playing it
+		int8_t prev = kNone;     // LRU links (leaders only)
+		int8_t next = kNone;
+		VoiceMask group;         // group members (leaders only)
+		uint64_t seq = 0;        // start order, to compare ages across channels (leaders only)
 	};
 
 	// Per-MIDI-channel allocation state.
 	struct MidiChannelState {
 		VoiceConfig config;
-		std::vector<Voice> voices; // one per OPL3 channel in config.opl3_channels
+		VoiceMask pool;       // channels in config.opl3_channels
+		std::array<uint8_t, kMaxChannels> order; // pool channels in configured order
+		std::array<uint8_t, kMaxChannels> rank;  // position in order, by channel
+		bool ascending = true;   // order is by channel index
+		VoiceMask sounding;   // pool channels playing a note
+		VoiceMask sustained;  // sounding channels held by the sustain pedal
+		int8_t lru_head = kNone; // oldest group leader
+		int8_t lru_tail = kNone; // newest group leader
+		std::array<int8_t, 128> note_leader; // group leader per MIDI note, or kNone
+
+		// Dynamic pool
+		ChannelLimits limits;
+		VoiceMask patched;    // channels currently carrying this channel's patch
+		std::array<uint8_t, kPatchRegs> patch = {};
 
 		// Shadow MIDI state for broadcasting CCs
 		uint8_t volume = 100;
@@ -123,16 +324,43 @@ private:
 
 	// Voice allocation helpers
 	struct AllocResult {
-		std::vector<int> slot_indices; // indices into voices[]
+		VoiceMask voices; // allocated channels
+		std::array<uint8_t, kMaxChannels> order; // voices in unison index order
+		int count = 0;
 		bool stolen = false;
+
+		void add(int ch)
+		{
+			voices.set(ch);
+			order[count++] = static_cast<uint8_t>(ch);
+		}
 	};
+	// Rebuild pool, order and rank from config.opl3_channels, skipping
+	// duplicates and channels past channel_count().
+	void set_pool(MidiChannelState &mcs);
 	AllocResult allocate_slots(MidiChannelState &mcs, int count);
 	void steal_oldest_group(MidiChannelState &mcs, int group_size);
-	void release_voice_slots(uint8_t midi_ch, const std::vector<int> &slots);
 
-	// Compute detuned frequency for a unison voice.
-	static void compute_detuned_freq(uint8_t note, int voice_idx, int unison_count,
-	                                  uint8_t detune_cents, uint16_t &f_num, uint8_t &block);
+	// Note groups: start one for a note on the given voices, or release
+	// voices (a whole group, or single voices of one) and key them off.
+	void start_group(MidiChannelState &mcs, uint8_t note, const VoiceMask &voices);
+	void release_group(MidiChannelState &mcs, uint8_t leader);
+	void release_voice(MidiChannelState &mcs, uint8_t ch);
+	void release_all(MidiChannelState &mcs);
+	void lru_unlink(MidiChannelState &mcs, uint8_t leader);
+
+	// Dynamic pool helpers
+	VoiceMask dynamic_pool() const;
+	AllocResult allocate_dynamic(uint8_t midi_ch, int count);
+	bool steal_for(uint8_t midi_ch);
+	int unmet_reservations(uint8_t except_midi_ch) const;
+	void take_patch(uint8_t ch, uint8_t midi_ch);
+	void save_patch(uint8_t midi_ch, uint8_t ch);
+	void enter_dynamic();
+	void leave_dynamic();
+
+	// Pitch offset of a unison voice, in opl3::kPitchSteps units.
+	static int16_t detune_pitch(int voice_idx, int unison_count, uint8_t detune_cents);
 
 	// Recompute pitch bend for all sounding voices on a MIDI channel.
 	void recompute_bend(uint8_t midi_ch);
@@ -142,18 +370,40 @@ private:
 	void sysex_voice_query(const uint8_t *data, size_t len);
 	void sysex_perc_config(const uint8_t *data, size_t len);
 	void sysex_perc_query();
+	void sysex_pool_config(const uint8_t *data, size_t len);
+	void sysex_pool_query();
+
+	// Forward a SysEx message not handled here: resets go to every card,
+	// everything else to card 0.
+	void forward_sysex(const uint8_t *data, size_t len);
+
+	// Per-channel DirectMode calls, addressed by global channel index.
+	DirectMode &card(uint8_t ch) { return *cards_[ch / kChannelsPerCard]; }
+	static uint8_t card_channel(uint8_t ch) { return ch % kChannelsPerCard; }
+	void play_channel(uint8_t ch, uint8_t note, uint8_t vel);
+	void release_channel(uint8_t ch);
+	void bend_channel(uint8_t ch, uint16_t f_num, uint8_t block);
+	void cc_channel(uint8_t ch, uint8_t cc, uint8_t val);
+	void cc_voices(const VoiceMask &voices, uint8_t cc, uint8_t val);
+	void nrpn_channel(uint8_t ch, uint8_t msb, uint8_t lsb, uint8_t val);
 
 	// Check if a note-on/off should be routed to a percussion drum.
 	// Returns true if handled by percussion.
 	bool try_perc_note_on(uint8_t midi_ch, uint8_t note, uint8_t vel);
 	bool try_perc_note_off(uint8_t midi_ch, uint8_t note);
 
-	DirectMode &dm_;
+	DirectMode &dm_; // card 0
 	OPL3State &state_;
+	std::vector<DirectMode *> cards_;
 	uint8_t device_id_;
 	MidiOutputFn midi_output_;
-	uint64_t timestamp_counter_ = 0;
 	std::array<MidiChannelState, 16> midi_channels_;
+	std::array<Voice, kMaxChannels> voices_;
+	VoiceMask busy_;        // union of all channels' sounding masks
+	uint64_t group_seq_ = 0;
+
+	PoolMode pool_mode_ = PoolMode::Static;
+	std::array<int8_t, kMaxChannels> patch_owner_; // MIDI channel whose patch is loaded, or kNone
 
 	// Percussion state
 	bool perc_mode_ = false;
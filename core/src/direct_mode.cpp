@@ -16,13 +16,175 @@
 */
 
 #include <retrowave/direct_mode.h>
-#include <cmath>
 #include <algorithm>
 
 namespace retrowave {
 
 using namespace opl3;
 
+// --- Level tables ---
+
+// ln(x) for x > 0, usable in constant expressions: scale x into [1, 2),
+// then ln(m) = 2 * atanh((m - 1) / (m + 1)) by its series.
+static constexpr double const_ln(double x)
+{
+	constexpr double kLn2 = 0.693147180559945309417;
+	int exp2 = 0;
+	while (x >= 2.0) { x /= 2.0; ++exp2; }
+	while (x < 1.0) { x *= 2.0; --exp2; }
+	double y = (x - 1.0) / (x + 1.0);
+	double y2 = y * y, term = y, sum = 0.0;
+	for (int i = 1; i < 60; i += 2) {
+		sum += term / i;
+		term *= y2;
+	}
+	return 2.0 * sum + exp2 * kLn2;
+}
+
+// OPL3 attenuation steps (0.75 dB each) of a 7-bit level:
+// -20 * log10(v / 127) / 0.75. Unused for v = 0.
+struct LevelSteps {
+	double steps[128] = {};
+
+	constexpr LevelSteps()
+	{
+		constexpr double kLn10 = 2.302585092994045684018;
+		for (int v = 1; v < 128; ++v)
+			steps[v] = -20.0 * (const_ln(v) - const_ln(127)) / kLn10 / 0.75;
+	}
+};
+
+static constexpr LevelSteps kLevelSteps;
+
+// Attenuation (0-63) of two 7-bit levels combined multiplicatively,
+// -20 * log10((a/127) * (b/127)) / 0.75 rounded and clamped. Either at 0
+// is silence. Serves volume x expression and mod wheel x brightness.
+struct LevelAttenTable {
+	uint8_t atten[128][128] = {};
+
+	constexpr LevelAttenTable()
+	{
+		for (int a = 0; a < 128; ++a) {
+			for (int b = 0; b < 128; ++b) {
+				int steps = 63;
+				if (a && b)
+					steps = static_cast<int>(kLevelSteps.steps[a] + kLevelSteps.steps[b] + 0.5);
+				atten[a][b] = static_cast<uint8_t>(steps > 63 ? 63 : steps);
+			}
+		}
+	}
+};
+
+static constexpr LevelAttenTable kLevelAtten;
+
+// Attenuation (0-63) added for a note-on velocity, per VelocityCurve.
+struct VelocityTable {
+	uint8_t atten[3][128] = {};
+
+	constexpr VelocityTable()
+	{
+		for (int v = 0; v < 128; ++v) {
+			// Linear: 0.75 dB per two velocity steps
+			atten[0][v] = static_cast<uint8_t>((127 - v) >> 1);
+			// ADL: amplitude proportional to velocity, like volume
+			atten[1][v] = kLevelAtten.atten[v][127];
+			// Exponential: amplitude proportional to velocity squared
+			atten[2][v] = kLevelAtten.atten[v][v];
+		}
+	}
+};
+
+static constexpr VelocityTable kVelocityAtten;
+
+// --- NRPN tables ---
+
+// One NRPN-addressable register field: the top bits of the MIDI value
+// (val >> drop) are placed at shift, under mask. mask 0 means no field.
+struct NrpnField {
+	uint16_t addr;
+	uint8_t mask;
+	uint8_t shift;
+	uint8_t drop;
+};
+
+static constexpr NrpnField make_field(uint16_t addr, uint8_t shift, uint8_t width)
+{
+	return {addr, static_cast<uint8_t>(((1 << width) - 1) << shift), shift,
+	        static_cast<uint8_t>(7 - width)};
+}
+
+static constexpr int kNrpnOpParams = 12;
+static constexpr int kNrpnChannelParams = 6;
+
+// Operator parameters (MSB 0-3) by LSB: register bank, shift, width
+struct OpParam {
+	uint8_t reg;
+	uint8_t shift;
+	uint8_t width;
+};
+
+static constexpr OpParam kOpParams[kNrpnOpParams] = {
+	{kRegAR_DR, 4, 4},         // 0: Attack Rate
+	{kRegAR_DR, 0, 4},         // 1: Decay Rate
+	{kRegSL_RR, 4, 4},         // 2: Sustain Level
+	{kRegSL_RR, 0, 4},         // 3: Release Rate
+	{kRegWaveform, 0, 3},      // 4: Waveform
+	{kRegAMVibEGKSMult, 0, 4}, // 5: Frequency Multiplier
+	{kRegKSLTL, 0, 6},         // 6: Output Level
+	{kRegKSLTL, 6, 2},         // 7: Key Scale Level
+	{kRegAMVibEGKSMult, 7, 1}, // 8: Tremolo AM
+	{kRegAMVibEGKSMult, 6, 1}, // 9: Vibrato
+	{kRegAMVibEGKSMult, 5, 1}, // 10: Sustain Mode EGT
+	{kRegAMVibEGKSMult, 4, 1}, // 11: KSR
+};
+
+// Every operator and channel NRPN field of the 18 channels. Operators 2-3
+// and the 4-op channel parameters exist only on the first channel of a
+// pair (0-2, 9-11), whose partner holds operators 2-3.
+struct NrpnTable {
+	NrpnField op[18][4][kNrpnOpParams] = {};
+	NrpnField channel[18][kNrpnChannelParams] = {};
+
+	constexpr NrpnTable()
+	{
+		for (int ch = 0; ch < 18; ++ch) {
+			uint16_t base = ch >= 9 ? 0x100 : 0x000;
+			int opl_ch = ch % 9;
+			bool first_of_pair = opl_ch < 3;
+			int pair_ch = opl_ch + 3;
+
+			for (int idx = 0; idx < 4; ++idx) {
+				if (idx >= 2 && !first_of_pair)
+					continue;
+				uint8_t op_off = idx < 2 ? kOperatorOffset[opl_ch][idx]
+				                         : kOperatorOffset[pair_ch][idx - 2];
+				for (int p = 0; p < kNrpnOpParams; ++p) {
+					const OpParam &param = kOpParams[p];
+					op[ch][idx][p] = make_field(base | (param.reg + op_off),
+					                            param.shift, param.width);
+				}
+			}
+
+			uint16_t c0 = base | (kRegFeedbackConn + opl_ch);
+			channel[ch][0] = make_field(c0, 1, 3); // Feedback
+			channel[ch][1] = make_field(c0, 0, 1); // Connection FM/AM
+			channel[ch][2] = make_field(c0, 4, 1); // Pan Left
+			channel[ch][3] = make_field(c0, 5, 1); // Pan Right
+			if (first_of_pair) {
+				// 4-op Enable, and the secondary connection on the partner's C0
+				uint8_t bit = four_op_enable_bit(ch);
+				uint8_t bit_shift = 0;
+				while (!(bit >> bit_shift & 1))
+					++bit_shift;
+				channel[ch][4] = make_field(kReg4OpEnable, bit_shift, 1);
+				channel[ch][5] = make_field(base | (kRegFeedbackConn + pair_ch), 0, 1);
+			}
+		}
+	}
+};
+
+static constexpr NrpnTable kNrpnTable;
+
 DirectMode::DirectMode(OPL3State &state, uint8_t device_id)
 	: state_(state), device_id_(device_id)
 {
@@ -30,6 +192,7 @@ DirectMode::DirectMode(OPL3State &state, uint8_t device_id)
 
 void DirectMode::init()
 {
+	OPL3State::Batch batch(state_);
 	state_.reset();
 	for (auto &ch : channels_)
 		ch = ChannelState{};
@@ -130,13 +293,13 @@ void DirectMode::handle_note_on(uint8_t ch, uint8_t note, uint8_t vel)
 	uint8_t car_off = kOperatorOffset[map.opl_ch][1];
 	uint8_t base_atten = compute_attenuation(cs.volume, cs.expression);
 	// Scale by velocity: vel 127 = no additional attenuation
-	uint8_t vel_atten = static_cast<uint8_t>((127 - vel) >> 1); // 0-63
+	uint8_t vel_atten = velocity_attenuation(vel); // 0-63
 	uint8_t total_atten = std::min<int>(base_atten + vel_atten, 63);
 
 	// Preserve KSL bits (7-6), set total level (5-0)
 	state_.modify_bits(map.port_base | (kRegKSLTL + car_off), 0x3F, total_atten);
 
-	write_freq(ch, nf.f_num, nf.block, true);
+	write_freq(ch, nf.f_num, nf.block, true, true);
 }
 
 void DirectMode::handle_note_off(uint8_t ch, uint8_t note)
@@ -159,7 +322,8 @@ void DirectMode::handle_note_off(uint8_t ch, uint8_t note)
 	cs.sustained_note = false;
 }
 
-void DirectMode::write_freq(uint8_t ch, uint16_t f_num, uint8_t block, bool key_on)
+void DirectMode::write_freq(uint8_t ch, uint16_t f_num, uint8_t block, bool key_on,
+                            bool retrigger)
 {
 	const auto &map = kChannelToOPL3[ch];
 	uint16_t base = map.port_base;
@@ -172,7 +336,10 @@ void DirectMode::write_freq(uint8_t ch, uint16_t f_num, uint8_t block, bool key_
 	uint8_t b0 = static_cast<uint8_t>(((f_num >> 8) & 0x03) |
 	                                   ((block & 0x07) << 2) |
 	                                   (key_on ? 0x20 : 0x00));
-	state_.write(base | (kRegKeyOnBlkFNum + opl_ch), b0);
+	if (retrigger)
+		state_.write_force(base | (kRegKeyOnBlkFNum + opl_ch), b0);
+	else
+		state_.write(base | (kRegKeyOnBlkFNum + opl_ch), b0);
 }
 
 // --- CC handling ---
@@ -225,17 +392,17 @@ void DirectMode::cc_pan(uint8_t ch, uint8_t val)
 {
 	channels_[ch].pan = val;
 	const auto &map = kChannelToOPL3[ch];
+	state_.modify_bits(map.port_base | (kRegFeedbackConn + map.opl_ch), 0x30, pan_bits(val));
+}
 
+uint8_t DirectMode::pan_bits(uint8_t val)
+{
 	// OPL3 pan: bits 4 (left) and 5 (right) of register C0+ch
-	uint8_t pan_bits = 0;
 	if (val <= 42)
-		pan_bits = 0x10; // Left only
-	else if (val >= 85)
-		pan_bits = 0x20; // Right only
-	else
-		pan_bits = 0x30; // Both (center)
-
-	state_.modify_bits(map.port_base | (kRegFeedbackConn + map.opl_ch), 0x30, pan_bits);
+		return 0x10; // Left only
+	if (val >= 85)
+		return 0x20; // Right only
+	return 0x30;     // Both (center)
 }
 
 void DirectMode::cc_expression(uint8_t ch, uint8_t val)
@@ -275,19 +442,7 @@ void DirectMode::update_modulator_level(uint8_t ch)
 	// Combine mod wheel and brightness multiplicatively.
 	// Higher mod_wheel = more modulation (less attenuation).
 	// Higher brightness = brighter sound (less attenuation).
-	double mod_factor = cs.mod_wheel / 127.0;
-	double bright_factor = cs.brightness / 127.0;
-	double combined = mod_factor * bright_factor;
-
-	uint8_t atten;
-	if (combined < 0.001)
-		atten = 63;
-	else {
-		int a = static_cast<int>(-20.0 * std::log10(combined) / 0.75 + 0.5);
-		if (a < 0) a = 0;
-		if (a > 63) a = 63;
-		atten = static_cast<uint8_t>(a);
-	}
+	uint8_t atten = kLevelAtten.atten[cs.mod_wheel & 0x7F][cs.brightness & 0x7F];
 
 	state_.modify_bits(map.port_base | (kRegKSLTL + mod_off), 0x3F, atten);
 }
@@ -319,15 +474,20 @@ void DirectMode::cc_all_notes_off(uint8_t ch)
 void DirectMode::update_carrier_level(uint8_t ch)
 {
 	if (ch >= 18) return;
+	auto &cs = channels_[ch];
+	write_carrier_level(ch, compute_attenuation(cs.volume, cs.expression));
+}
+
+void DirectMode::write_carrier_level(uint8_t ch, uint8_t base_atten)
+{
 	auto &cs = channels_[ch];
 	const auto &map = kChannelToOPL3[ch];
 	uint8_t car_off = kOperatorOffset[map.opl_ch][1];
 
-	uint8_t base_atten = compute_attenuation(cs.volume, cs.expression);
 	// Factor in velocity if a note is playing
 	uint8_t vel_atten = 0;
 	if (cs.current_note >= 0)
-		vel_atten = static_cast<uint8_t>((127 - cs.note_velocity) >> 1);
+		vel_atten = velocity_attenuation(cs.note_velocity);
 	uint8_t total = std::min<int>(base_atten + vel_atten, 63);
 
 	state_.modify_bits(map.port_base | (kRegKSLTL + car_off), 0x3F, total);
@@ -335,17 +495,14 @@ void DirectMode::update_carrier_level(uint8_t ch)
 
 uint8_t DirectMode::compute_attenuation(uint8_t volume, uint8_t expression)
 {
-	if (volume == 0 || expression == 0)
-		return 63; // Full attenuation (silence)
-
 	// Multiplicative volume model: combined = (vol/127) * (expr/127)
 	// OPL3 attenuation = -20*log10(combined) / 0.75, clamped 0-63
-	double combined = (volume / 127.0) * (expression / 127.0);
-	double atten_db = -20.0 * std::log10(combined);
-	int atten = static_cast<int>(atten_db / 0.75 + 0.5);
-	if (atten < 0) atten = 0;
-	if (atten > 63) atten = 63;
-	return static_cast<uint8_t>(atten);
+	return kLevelAtten.atten[volume & 0x7F][expression & 0x7F];
+}
+
+uint8_t DirectMode::velocity_attenuation(uint8_t vel) const
+{
+	return kVelocityAtten.atten[static_cast<int>(velocity_curve_)][vel & 0x7F];
 }
 
 // --- Pitch Bend ---
@@ -358,37 +515,15 @@ void DirectMode::handle_pitch_bend(uint8_t ch, uint16_t bend)
 		return;
 
 	// Bend range from RPN 0x0000 (default ±2 semitones). Center = 8192.
-	double range = cs.bend_range_semitones + cs.bend_range_cents / 100.0;
-	double semitones = (static_cast<int>(bend) - 8192) * range / 8192.0;
-	double freq = 440.0 * std::pow(2.0, (cs.current_note - 69.0 + semitones) / 12.0);
-
-	// Convert to F-Num + Block
-	static constexpr double kOPL3FreqBase = 49716.0;
-	uint16_t f_num = 0;
-	uint8_t block = 0;
-
-	for (int b = 0; b < 8; ++b) {
-		double divisor = kOPL3FreqBase / static_cast<double>(1 << (20 - b));
-		double f = freq / divisor;
-		int fn = static_cast<int>(f + 0.5);
-		if (fn <= 1023) {
-			if (fn < 0) fn = 0;
-			f_num = static_cast<uint16_t>(fn);
-			block = static_cast<uint8_t>(b);
-			break;
-		}
-		if (b == 7) {
-			f_num = 1023;
-			block = 7;
-		}
-	}
+	NoteFreq nf = pitch_freq(cs.current_note * kPitchSteps +
+	                         bend_pitch(bend, cs.bend_range_semitones, cs.bend_range_cents));
 
 	// Preserve current key-on state rather than forcing key-on=true,
 	// to avoid re-triggering the OPL3 envelope on sustained notes.
 	const auto &map = kChannelToOPL3[ch];
 	uint8_t cur_b0 = state_.read(map.port_base | (kRegKeyOnBlkFNum + map.opl_ch));
 	bool current_key_on = (cur_b0 & 0x20) != 0;
-	write_freq(ch, f_num, block, current_key_on);
+	write_freq(ch, nf.f_num, nf.block, current_key_on);
 }
 
 // --- NRPN ---
@@ -452,139 +587,24 @@ void DirectMode::nrpn_apply(uint8_t ch, uint8_t msb, uint8_t lsb, uint8_t val)
 
 void DirectMode::nrpn_operator(uint8_t ch, uint8_t op_idx, uint8_t param, uint8_t val)
 {
-	if (ch >= 18) return;
-	const auto &map = kChannelToOPL3[ch];
-	uint16_t base = map.port_base;
-	uint8_t opl_ch = map.opl_ch;
-
 	// op_idx 0-1: operators on this channel
 	// op_idx 2-3: operators on paired channel (4-op mode only)
-	uint8_t op_off;
-	if (op_idx <= 1) {
-		op_off = kOperatorOffset[opl_ch][op_idx];
-	} else {
-		// 4-op: find the paired channel. Channels 0-2 pair with 3-5.
-		uint8_t pair_ch = 0xFF;
-		for (auto &p : kFourOpPairs) {
-			if (p[0] == opl_ch) { pair_ch = p[1]; break; }
-		}
-		if (pair_ch == 0xFF) return; // Not a 4-op capable channel
-		op_off = kOperatorOffset[pair_ch][op_idx - 2];
-	}
+	if (ch >= 18 || op_idx > 3 || param >= kNrpnOpParams) return;
+	const NrpnField &f = kNrpnTable.op[ch][op_idx][param];
+	if (!f.mask) return; // Not a 4-op capable channel
 
 	val &= 0x7F; // Clamp to MIDI range
-
-	switch (param) {
-	case 0: // Attack Rate (bits 7-4 of 0x60+off)
-		state_.modify_bits(base | (kRegAR_DR + op_off), 0xF0,
-		                   static_cast<uint8_t>((val >> 3) << 4));
-		break;
-	case 1: // Decay Rate (bits 3-0 of 0x60+off)
-		state_.modify_bits(base | (kRegAR_DR + op_off), 0x0F,
-		                   static_cast<uint8_t>(val >> 3));
-		break;
-	case 2: // Sustain Level (bits 7-4 of 0x80+off)
-		state_.modify_bits(base | (kRegSL_RR + op_off), 0xF0,
-		                   static_cast<uint8_t>((val >> 3) << 4));
-		break;
-	case 3: // Release Rate (bits 3-0 of 0x80+off)
-		state_.modify_bits(base | (kRegSL_RR + op_off), 0x0F,
-		                   static_cast<uint8_t>(val >> 3));
-		break;
-	case 4: // Waveform (bits 2-0 of 0xE0+off)
-		state_.modify_bits(base | (kRegWaveform + op_off), 0x07,
-		                   static_cast<uint8_t>(val >> 4));
-		break;
-	case 5: // Frequency Multiplier (bits 3-0 of 0x20+off)
-		state_.modify_bits(base | (kRegAMVibEGKSMult + op_off), 0x0F,
-		                   static_cast<uint8_t>(val >> 3));
-		break;
-	case 6: // Output Level (bits 5-0 of 0x40+off)
-		state_.modify_bits(base | (kRegKSLTL + op_off), 0x3F,
-		                   static_cast<uint8_t>(val >> 1));
-		break;
-	case 7: // Key Scale Level (bits 7-6 of 0x40+off)
-		state_.modify_bits(base | (kRegKSLTL + op_off), 0xC0,
-		                   static_cast<uint8_t>((val >> 5) << 6));
-		break;
-	case 8: // Tremolo AM (bit 7 of 0x20+off)
-		state_.modify_bits(base | (kRegAMVibEGKSMult + op_off), 0x80,
-		                   static_cast<uint8_t>(val >= 64 ? 0x80 : 0x00));
-		break;
-	case 9: // Vibrato (bit 6 of 0x20+off)
-		state_.modify_bits(base | (kRegAMVibEGKSMult + op_off), 0x40,
-		                   static_cast<uint8_t>(val >= 64 ? 0x40 : 0x00));
-		break;
-	case 10: // Sustain Mode EGT (bit 5 of 0x20+off)
-		state_.modify_bits(base | (kRegAMVibEGKSMult + op_off), 0x20,
-		                   static_cast<uint8_t>(val >= 64 ? 0x20 : 0x00));
-		break;
-	case 11: // KSR (bit 4 of 0x20+off)
-		state_.modify_bits(base | (kRegAMVibEGKSMult + op_off), 0x10,
-		                   static_cast<uint8_t>(val >= 64 ? 0x10 : 0x00));
-		break;
-	default:
-		break;
-	}
+	state_.modify_bits(f.addr, f.mask, static_cast<uint8_t>((val >> f.drop) << f.shift));
 }
 
 void DirectMode::nrpn_channel(uint8_t ch, uint8_t param, uint8_t val)
 {
-	if (ch >= 18) return;
-	const auto &map = kChannelToOPL3[ch];
-	uint16_t base = map.port_base;
-	uint8_t opl_ch = map.opl_ch;
+	if (ch >= 18 || param >= kNrpnChannelParams) return;
+	const NrpnField &f = kNrpnTable.channel[ch][param];
+	if (!f.mask) return; // 4-op parameters on a channel that is not first of a pair
 
-	switch (param) {
-	case 0: // Feedback (bits 3-1 of 0xC0+ch)
-		state_.modify_bits(base | (kRegFeedbackConn + opl_ch), 0x0E,
-		                   static_cast<uint8_t>((val >> 4) << 1));
-		break;
-	case 1: // Connection FM/AM (bit 0 of 0xC0+ch)
-		state_.modify_bits(base | (kRegFeedbackConn + opl_ch), 0x01,
-		                   static_cast<uint8_t>(val >= 64 ? 0x01 : 0x00));
-		break;
-	case 2: // Pan Left (bit 4 of 0xC0+ch)
-		state_.modify_bits(base | (kRegFeedbackConn + opl_ch), 0x10,
-		                   static_cast<uint8_t>(val >= 64 ? 0x10 : 0x00));
-		break;
-	case 3: // Pan Right (bit 5 of 0xC0+ch)
-		state_.modify_bits(base | (kRegFeedbackConn + opl_ch), 0x20,
-		                   static_cast<uint8_t>(val >= 64 ? 0x20 : 0x00));
-		break;
-	case 4: { // 4-op Enable (bit in 0x104)
-		// Find which 4-op pair this channel belongs to
-		int pair_idx = -1;
-		int port_offset = (base == 0x100) ? 3 : 0;
-		for (int i = 0; i < 3; ++i) {
-			if (kFourOpPairs[i][0] == opl_ch) {
-				pair_idx = i + port_offset;
-				break;
-			}
-		}
-		if (pair_idx >= 0) {
-			state_.modify_bits(kReg4OpEnable, kFourOpEnableBit[pair_idx],
-			                   val >= 64 ? kFourOpEnableBit[pair_idx] : 0);
-		}
-		break;
-	}
-	case 5: { // 4-op Secondary Connection (conn bit on paired channel's C0)
-		// In 4-op mode, the second connection bit controls the routing
-		// between the second pair of operators. It lives on the paired
-		// channel's C0 register.
-		uint8_t pair_opl_ch = 0xFF;
-		for (auto &p : kFourOpPairs) {
-			if (p[0] == opl_ch) { pair_opl_ch = p[1]; break; }
-		}
-		if (pair_opl_ch != 0xFF) {
-			state_.modify_bits(base | (kRegFeedbackConn + pair_opl_ch), 0x01,
-			                   static_cast<uint8_t>(val >= 64 ? 0x01 : 0x00));
-		}
-		break;
-	}
-	default:
-		break;
-	}
+	val &= 0x7F;
+	state_.modify_bits(f.addr, f.mask, static_cast<uint8_t>((val >> f.drop) << f.shift));
 }
 
 void DirectMode::nrpn_global(uint8_t param, uint8_t val)
@@ -602,6 +622,9 @@ void DirectMode::nrpn_global(uint8_t param, uint8_t val)
 		state_.modify_bits(kRegBD, 0x20,
 		                   static_cast<uint8_t>(val >= 64 ? 0x20 : 0x00));
 		break;
+	case 3: // Velocity Curve (no register; thirds of the range)
+		velocity_curve_ = static_cast<VelocityCurve>(val / 43);
+		break;
 	default:
 		break;
 	}
@@ -679,6 +702,7 @@ void DirectMode::sysex_batch_write_7(const uint8_t *data, size_t len)
 {
 	// count, [reg-hi, reg-lo, value]...
 	if (len < 1) return;
+	OPL3State::Batch batch(state_);
 	uint8_t count = data[0];
 	const uint8_t *p = data + 1;
 	size_t remaining = len - 1;
@@ -696,6 +720,7 @@ void DirectMode::sysex_batch_write_8(const uint8_t *data, size_t len)
 {
 	// count, [reg-hi, reg-lo, val-hi, val-lo]...
 	if (len < 1) return;
+	OPL3State::Batch batch(state_);
 	uint8_t count = data[0];
 	const uint8_t *p = data + 1;
 	size_t remaining = len - 1;
@@ -725,21 +750,7 @@ void DirectMode::sysex_patch_dump(const uint8_t *data, size_t len)
 
 	// Check if channel is in 4-op mode
 	int partner = four_op_partner(midi_ch);
-	bool is_four_op = false;
-	if (partner >= 0) {
-		// Check if 4-op is enabled for this pair
-		int primary = std::min(midi_ch, static_cast<uint8_t>(partner));
-		int port_offset = (base == 0x100) ? 3 : 0;
-		int pair_idx = -1;
-		for (int i = 0; i < 3; ++i) {
-			if (kFourOpPairs[i][0] == kChannelToOPL3[primary].opl_ch) {
-				pair_idx = i + port_offset;
-				break;
-			}
-		}
-		if (pair_idx >= 0)
-			is_four_op = (state_.read(kReg4OpEnable) & kFourOpEnableBit[pair_idx]) != 0;
-	}
+	bool is_four_op = (state_.read(kReg4OpEnable) & four_op_enable_bit(midi_ch)) != 0;
 
 	int num_ops = is_four_op ? 4 : 2;
 
@@ -813,6 +824,9 @@ void DirectMode::sysex_patch_load(const uint8_t *data, size_t len)
 	uint16_t base = map.port_base;
 	uint8_t opl_ch = map.opl_ch;
 
+	// All operators reach the chip in the same frame
+	OPL3State::Batch batch(state_);
+
 	int partner = four_op_partner(midi_ch);
 	const uint8_t *p = data + 1;
 	size_t remaining = len - 1;
@@ -897,12 +911,12 @@ void DirectMode::play_note_on_channel(uint8_t opl3_ch, uint8_t note, uint8_t vel
 	// Set carrier output level based on velocity + volume + expression
 	uint8_t car_off = kOperatorOffset[map.opl_ch][1];
 	uint8_t base_atten = compute_attenuation(cs.volume, cs.expression);
-	uint8_t vel_atten = static_cast<uint8_t>((127 - vel) >> 1);
+	uint8_t vel_atten = velocity_attenuation(vel);
 	uint8_t total_atten = std::min<int>(base_atten + vel_atten, 63);
 
 	state_.modify_bits(map.port_base | (kRegKSLTL + car_off), 0x3F, total_atten);
 
-	write_freq(opl3_ch, nf.f_num, nf.block, true);
+	write_freq(opl3_ch, nf.f_num, nf.block, true, true);
 }
 
 void DirectMode::release_note_on_channel(uint8_t opl3_ch)
@@ -947,6 +961,51 @@ void DirectMode::apply_cc_to_channel(uint8_t opl3_ch, uint8_t cc, uint8_t val)
 	}
 }
 
+void DirectMode::apply_cc_to_channels(uint32_t mask, uint8_t cc, uint8_t val)
+{
+	mask &= (1u << 18) - 1;
+
+	switch (cc) {
+	case 7:
+	case 11: {
+		// Pool channels normally share the other controller, so the
+		// base attenuation is looked up again only when it changes
+		int other = -1;
+		uint8_t base = 0;
+		for (; mask; mask &= mask - 1) {
+			uint8_t ch = static_cast<uint8_t>(__builtin_ctz(mask));
+			auto &cs = channels_[ch];
+			if (cc == 7)
+				cs.volume = val;
+			else
+				cs.expression = val;
+			uint8_t o = cc == 7 ? cs.expression : cs.volume;
+			if (o != other) {
+				other = o;
+				base = compute_attenuation(cs.volume, cs.expression);
+			}
+			write_carrier_level(ch, base);
+		}
+		break;
+	}
+	case 10: {
+		// Same pan bits for every channel
+		uint8_t bits = pan_bits(val);
+		for (; mask; mask &= mask - 1) {
+			uint8_t ch = static_cast<uint8_t>(__builtin_ctz(mask));
+			channels_[ch].pan = val;
+			const auto &map = kChannelToOPL3[ch];
+			state_.modify_bits(map.port_base | (kRegFeedbackConn + map.opl_ch), 0x30, bits);
+		}
+		break;
+	}
+	default:
+		for (; mask; mask &= mask - 1)
+			apply_cc_to_channel(static_cast<uint8_t>(__builtin_ctz(mask)), cc, val);
+		break;
+	}
+}
+
 // --- Percussion ---
 
 // Drum → OPL3 channel (port 0), BD key-on bit mask
@@ -987,11 +1046,11 @@ void DirectMode::perc_note_on(Drum drum, uint8_t note, uint8_t vel)
 		kOperatorOffset[7][0],
 	};
 	uint8_t drum_op = kDrumOperator[drum];
-	uint8_t vel_atten = static_cast<uint8_t>((127 - vel) >> 1); // 0-63
+	uint8_t vel_atten = velocity_attenuation(vel); // 0-63
 	state_.modify_bits(kRegKSLTL + drum_op, 0x3F, vel_atten);
 
-	// Trigger key-on via BD register
-	state_.modify_bits(kRegBD, kDrumBDMask[drum], kDrumBDMask[drum]);
+	// Trigger key-on via BD register (forced, so a retrigger always reaches the chip)
+	state_.write_force(kRegBD, state_.read(kRegBD) | kDrumBDMask[drum]);
 }
 
 void DirectMode::perc_note_off(Drum drum)
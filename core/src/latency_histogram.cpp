@@ -0,0 +1,105 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <retrowave/latency_histogram.h>
+
+#include <cstdio>
+#include <cstring>
+
+namespace retrowave {
+
+LatencyHistogram::LatencyHistogram()
+{
+	clear();
+}
+
+int LatencyHistogram::bucket(uint64_t v)
+{
+	if (v < (1u << kSubBits))
+		return static_cast<int>(v);
+	int e = 63 - __builtin_clzll(v); // >= kSubBits
+	int sub = static_cast<int>((v >> (e - kSubBits)) & ((1u << kSubBits) - 1));
+	return ((e - kSubBits + 1) << kSubBits) + sub;
+}
+
+uint64_t LatencyHistogram::bucket_floor(int b)
+{
+	if (b < (1 << kSubBits))
+		return static_cast<uint64_t>(b);
+	int e = (b >> kSubBits) + kSubBits - 1;
+	uint64_t sub = static_cast<uint64_t>(b & ((1 << kSubBits) - 1));
+	return (1ull << e) | (sub << (e - kSubBits));
+}
+
+void LatencyHistogram::record(int64_t ns)
+{
+	if (ns < 0) {
+		early_++;
+		ns = 0;
+	}
+	buckets_[bucket(static_cast<uint64_t>(ns))]++;
+	if (!count_ || ns < min_)
+		min_ = ns;
+	if (!count_ || ns > max_)
+		max_ = ns;
+	sum_ += ns;
+	count_++;
+}
+
+void LatencyHistogram::clear()
+{
+	std::memset(buckets_, 0, sizeof(buckets_));
+	count_ = 0;
+	early_ = 0;
+	min_ = 0;
+	max_ = 0;
+	sum_ = 0;
+}
+
+int64_t LatencyHistogram::percentile(double p) const
+{
+	if (!count_)
+		return 0;
+	if (p <= 0.0)
+		return min_;
+	if (p >= 1.0)
+		return max_;
+
+	uint64_t rank = static_cast<uint64_t>(p * (count_ - 1));
+	uint64_t seen = 0;
+	for (int b = 0; b < kBuckets; ++b) {
+		seen += buckets_[b];
+		if (seen > rank) {
+			int64_t v = static_cast<int64_t>(bucket_floor(b));
+			return v < min_ ? min_ : v;
+		}
+	}
+	return max_;
+}
+
+std::string LatencyHistogram::summary() const
+{
+	char buf[160];
+	snprintf(buf, sizeof(buf),
+	         "n=%llu mean=%.1fus p50=%.1fus p99=%.1fus p99.9=%.1fus max=%.1fus",
+	         static_cast<unsigned long long>(count_), mean() / 1000.0,
+	         percentile(0.50) / 1000.0, percentile(0.99) / 1000.0,
+	         percentile(0.999) / 1000.0, max() / 1000.0);
+	return buf;
+}
+
+} // namespace retrowave
@@ -0,0 +1,46 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <retrowave/midi_clock.h>
+
+#include <chrono>
+
+namespace retrowave {
+
+int64_t monotonic_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t MidiTimestamper::stamp(double delta_sec, int64_t now_ns)
+{
+	int64_t t = last_ns_ + static_cast<int64_t>(delta_sec * 1e9);
+
+	if (!anchored_) {
+		t = now_ns;
+		anchored_ = true;
+	} else if (t > now_ns || now_ns - t > max_drift_ns_) {
+		t = now_ns;
+		reanchors_++;
+	}
+
+	last_ns_ = t;
+	return t;
+}
+
+} // namespace retrowave
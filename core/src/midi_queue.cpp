@@ -0,0 +1,102 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <retrowave/midi_queue.h>
+
+#include <cstring>
+#include <new>
+
+namespace retrowave {
+
+MidiQueue::MidiQueue(size_t slots)
+{
+	size_t n = 2;
+	while (n < slots)
+		n <<= 1;
+	slots_.resize(n);
+	mask_ = n - 1;
+}
+
+MidiQueue::~MidiQueue()
+{
+	clear();
+}
+
+bool MidiQueue::push(const uint8_t *data, size_t len, int64_t time_ns)
+{
+	size_t tail = tail_.load(std::memory_order_relaxed);
+	size_t depth = tail - head_.load(std::memory_order_acquire);
+	if (depth > mask_) {
+		dropped_full_.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	Slot &s = slots_[tail & mask_];
+	uint8_t *dst = s.data;
+	if (len > kMaxMessage) {
+		// Large SysEx: copy out of line, freed by the consumer
+		dst = new (std::nothrow) uint8_t[len];
+		if (!dst) {
+			dropped_oversize_.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		s.spill = dst;
+		oversize_.fetch_add(1, std::memory_order_relaxed);
+	}
+	s.time_ns = time_ns;
+	s.len = static_cast<uint32_t>(len);
+	std::memcpy(dst, data, len);
+	tail_.store(tail + 1, std::memory_order_release);
+
+	pushed_.fetch_add(1, std::memory_order_relaxed);
+	if (depth + 1 > max_depth_.load(std::memory_order_relaxed))
+		max_depth_.store(depth + 1, std::memory_order_relaxed);
+	return true;
+}
+
+bool MidiQueue::front_time(int64_t &time_ns) const
+{
+	size_t head = head_.load(std::memory_order_relaxed);
+	if (head == tail_.load(std::memory_order_acquire))
+		return false;
+	time_ns = slots_[head & mask_].time_ns;
+	return true;
+}
+
+void MidiQueue::clear()
+{
+	size_t head = head_.load(std::memory_order_relaxed);
+	size_t tail = tail_.load(std::memory_order_acquire);
+	for (; head != tail; ++head)
+		release(slots_[head & mask_]);
+	head_.store(tail, std::memory_order_release);
+}
+
+MidiQueue::Stats MidiQueue::stats() const
+{
+	Stats s;
+	s.depth = tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+	s.max_depth = max_depth_.load(std::memory_order_relaxed);
+	s.capacity = slots_.size();
+	s.pushed = pushed_.load(std::memory_order_relaxed);
+	s.dropped_full = dropped_full_.load(std::memory_order_relaxed);
+	s.oversize = oversize_.load(std::memory_order_relaxed);
+	s.dropped_oversize = dropped_oversize_.load(std::memory_order_relaxed);
+	return s;
+}
+
+} // namespace retrowave
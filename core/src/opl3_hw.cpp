@@ -17,43 +17,176 @@
 
 #include <retrowave/opl3_hw.h>
 #include <retrowave/protocol.h>
+#include <retrowave/serial_writer.h>
 
 namespace retrowave {
 
+// Size of one register write command and of the frame header, in raw bytes.
+static constexpr size_t kCmdSize = 6;
+static constexpr size_t kHeaderSize = 2;
+
+static size_t reg_index(uint16_t addr)
+{
+	return ((addr & 0x100) ? 256 : 0) + (addr & 0xFF);
+}
+
+// Mode, timer and test registers (incl. 0x104/0x105) and the board reset
+// triggers must reach the chip in order relative to everything else.
+static bool is_barrier_reg(uint16_t addr)
+{
+	uint8_t reg = addr & 0xFF;
+	return reg < 0x20 || reg >= 0xFE;
+}
+
+// Bits whose change must never be merged away (key-on / drum triggers).
+static uint8_t key_bits(uint16_t addr)
+{
+	uint8_t reg = addr & 0xFF;
+	if (reg >= 0xB0 && reg <= 0xB8)
+		return 0x20;
+	if (addr == 0xBD)
+		return 0x3F; // rhythm mode + BD/SD/TT/CY/HH key-on
+	return 0;
+}
+
 OPL3HardwareBuffer::OPL3HardwareBuffer(SerialPort &serial)
 	: serial_(serial)
 {
-	buf_.reserve(512);
+	for (auto &p : pending_)
+		p = kNoPending;
 	reset();
 }
 
 void OPL3HardwareBuffer::reset()
 {
-	buf_.clear();
-	buf_.push_back(0x21 << 1);
-	buf_.push_back(0x12);
+	// Clear only the slots this frame touched
+	const auto &raw = packer_.raw();
+	for (size_t off = kHeaderSize; off + kCmdSize <= raw.size(); off += kCmdSize) {
+		uint16_t addr = raw[off + 1] | (raw[off] == 0xe5 ? 0x100 : 0x000);
+		pending_[reg_index(addr)] = kNoPending;
+	}
+
+	packer_.reset();
+	static const uint8_t kHeader[kHeaderSize] = {0x21 << 1, 0x12};
+	packer_.append(kHeader, kHeaderSize);
+	barrier_ = kHeaderSize;
 }
 
 void OPL3HardwareBuffer::queue(uint16_t addr, uint8_t data)
 {
+	if (max_writes_ && (packer_.raw().size() - kHeaderSize) / kCmdSize >= max_writes_)
+		make_room();
+
 	bool port1 = (addr & 0x100) != 0;
+	size_t idx = reg_index(addr);
+	size_t end = packer_.raw().size();
+
+	if (is_barrier_reg(addr)) {
+		pending_[idx] = kNoPending;
+	} else if (coalesce_) {
+		uint32_t off = pending_[idx];
+		if (off != kNoPending && off >= barrier_) {
+			if (((packer_.raw()[off + 3] ^ data) & key_bits(addr)) == 0) {
+				packer_.update(off + 3, data);
+				packer_.update(off + 5, data);
+				coalesced_writes_++;
+				return;
+			}
+			// Key state changes: keep both, and keep later writes after it
+			barrier_ = end;
+		}
+		pending_[idx] = static_cast<uint32_t>(end);
+	}
 
-	buf_.push_back(port1 ? 0xe5 : 0xe1);
-	buf_.push_back(addr & 0xff);
-	buf_.push_back(port1 ? 0xe7 : 0xe3);
-	buf_.push_back(data);
-	buf_.push_back(0xfb);
-	buf_.push_back(data);
+	const uint8_t cmd[kCmdSize] = {
+		static_cast<uint8_t>(port1 ? 0xe5 : 0xe1),
+		static_cast<uint8_t>(addr & 0xff),
+		static_cast<uint8_t>(port1 ? 0xe7 : 0xe3),
+		data,
+		0xfb,
+		data,
+	};
+	packer_.append(cmd, kCmdSize);
+
+	if (is_barrier_reg(addr))
+		barrier_ = end + kCmdSize;
+}
+
+bool OPL3HardwareBuffer::empty() const
+{
+	return packer_.raw().size() <= kHeaderSize;
 }
 
 void OPL3HardwareBuffer::flush()
 {
-	std::vector<uint8_t> packed(buf_.size() * 2 + 8);
+	if (batch_depth_) {
+		flush_deferred_ = true;
+		return;
+	}
+	if (empty())
+		return;
+	send();
+}
 
-	size_t packed_len = protocol_serial_pack(buf_.data(), buf_.size(),
-	                                         packed.data());
-	serial_.write(packed.data(), packed_len);
+void OPL3HardwareBuffer::send()
+{
+	size_t packed_len = packer_.finish();
+	if (writer_)
+		writer_->submit(packer_.data(), packed_len);
+	else
+		serial_.write(packer_.data(), packed_len);
 	reset();
 }
 
+void OPL3HardwareBuffer::begin_batch()
+{
+	if (batch_depth_++)
+		return;
+
+	// With a bound, commands before the batch may go out in an earlier
+	// frame, so batch writes must not be merged into them
+	batch_start_ = packer_.raw().size();
+	if (max_writes_)
+		barrier_ = batch_start_;
+}
+
+void OPL3HardwareBuffer::end_batch()
+{
+	if (batch_depth_ == 0 || --batch_depth_)
+		return;
+
+	if (flush_deferred_) {
+		flush_deferred_ = false;
+		flush();
+	}
+}
+
+void OPL3HardwareBuffer::make_room()
+{
+	if (!batch_depth_) {
+		send();
+		return;
+	}
+
+	// A batch that fills the frame on its own grows past the bound
+	if (batch_start_ <= kHeaderSize)
+		return;
+
+	// Send the writes before the batch, then start the next frame with it
+	const auto &raw = packer_.raw();
+	carry_.assign(raw.begin() + batch_start_, raw.end());
+	for (size_t off = batch_start_; off + kCmdSize <= raw.size(); off += kCmdSize) {
+		uint16_t addr = raw[off + 1] | (raw[off] == 0xe5 ? 0x100 : 0x000);
+		pending_[reg_index(addr)] = kNoPending;
+	}
+	packer_.truncate(batch_start_);
+	send();
+
+	batch_start_ = kHeaderSize;
+	for (size_t off = 0; off + kCmdSize <= carry_.size(); off += kCmdSize) {
+		uint16_t addr = carry_[off + 1] | (carry_[off] == 0xe5 ? 0x100 : 0x000);
+		queue(addr, carry_[off + 3]);
+	}
+}
+
 } // namespace retrowave
@@ -16,7 +16,6 @@
 */
 
 #include <retrowave/opl3_registers.h>
-#include <cmath>
 
 namespace retrowave {
 namespace opl3 {
@@ -25,29 +24,82 @@ namespace opl3 {
 // We want: F-Num = f * 2^(20-Block) / 49716, choosing Block so F-Num fits in 10 bits.
 static constexpr double kOPL3FreqBase = 49716.0;
 
-static NoteFreq compute_note_freq(int note)
+// --- Pitch table ---
+
+static constexpr int kOctaveSteps = 12 * kPitchSteps;
+static constexpr int kFracBits = 16;
+
+// exp(x) by Taylor series, usable in constant expressions. Only called
+// with |x| < 6, where 40 terms are exact to double precision.
+static constexpr double const_exp(double x)
 {
-	double freq = 440.0 * std::pow(2.0, (note - 69.0) / 12.0);
+	double sum = 1.0, term = 1.0;
+	for (int i = 1; i < 40; ++i) {
+		term *= x / i;
+		sum += term;
+	}
+	return sum;
+}
 
-	for (int block = 0; block < 8; ++block) {
-		double divisor = kOPL3FreqBase / static_cast<double>(1 << (20 - block));
-		double f_num_d = freq / divisor;
-		int f_num = static_cast<int>(f_num_d + 0.5);
+static constexpr double kLn2 = 0.693147180559945309417;
 
-		if (f_num <= 1023) {
-			if (f_num < 0) f_num = 0;
-			return {static_cast<uint16_t>(f_num), static_cast<uint8_t>(block)};
+// F-Number at Block 0 of pitch step r (0 to kOctaveSteps - 1) above MIDI
+// note 0, with kFracBits fractional bits. Spans 172.4 to 344.7.
+struct OctaveTable {
+	uint32_t f_num[kOctaveSteps] = {};
+
+	constexpr OctaveTable()
+	{
+		for (int r = 0; r < kOctaveSteps; ++r) {
+			double semis = static_cast<double>(r) / kPitchSteps - 69.0;
+			double freq = 440.0 * const_exp(semis / 12.0 * kLn2);
+			double fn = freq * (1 << 20) / kOPL3FreqBase;
+			f_num[r] = static_cast<uint32_t>(fn * (1 << kFracBits) + 0.5);
 		}
 	}
+};
 
-	return {1023, 7};
+static constexpr OctaveTable kOctaveTable;
+
+NoteFreq pitch_freq(int32_t pitch)
+{
+	if (pitch < 0) pitch = 0;
+	int octave = pitch / kOctaveSteps;
+	uint32_t base = kOctaveTable.f_num[pitch % kOctaveSteps];
+
+	// The lowest Block whose F-Number fits: two octaves below if the
+	// doubled-twice F-Number still rounds under 1024, else one.
+	constexpr uint32_t kHalf = 1u << (kFracBits - 1);
+	int shift = ((base << 2) + kHalf) >> kFracBits <= 1023 ? 2 : 1;
+	if (octave < shift)
+		shift = octave;
+	int block = octave - shift;
+	if (block > 7)
+		return {1023, 7};
+	return {static_cast<uint16_t>(((base << shift) + kHalf) >> kFracBits),
+	        static_cast<uint8_t>(block)};
+}
+
+int32_t bend_pitch(uint16_t bend, uint8_t range_semitones, uint8_t range_cents)
+{
+	// (bend - 8192) / 8192 * range_cents / 100 * kPitchSteps
+	int64_t num = static_cast<int64_t>(static_cast<int>(bend) - 8192) *
+	              (range_semitones * 100 + range_cents) * kPitchSteps;
+	constexpr int64_t den = 8192 * 100;
+	return static_cast<int32_t>(num >= 0 ? (num + den / 2) / den : -((-num + den / 2) / den));
+}
+
+int32_t cents_pitch(double cents)
+{
+	double units = cents * kPitchSteps / 100.0;
+	return static_cast<int32_t>(units >= 0 ? units + 0.5 : units - 0.5);
 }
 
 struct NoteFreqTable {
 	NoteFreq entries[128];
 	NoteFreqTable() {
 		for (int i = 0; i < 128; ++i)
-			entries[i] = compute_note_freq(i);
+			entries[i] = pitch_freq(i * kPitchSteps);
 	}
 };
 
@@ -20,22 +20,41 @@
 
 namespace retrowave {
 
+// Timer/IRQ control and the board reset triggers act on the write itself,
+// not on the stored value, so they are never elided.
+static bool is_strobe(uint16_t addr)
+{
+	return addr == 0x002 || addr == 0x003 || addr == 0x004 ||
+	       addr == 0x0FE || addr == 0x0FF;
+}
+
 OPL3State::OPL3State(OPL3HardwareBuffer &hw)
 	: hw_(hw)
 {
 	std::memset(regs_, 0, sizeof(regs_));
+	std::memset(known_, 0, sizeof(known_));
 }
 
 uint8_t OPL3State::read(uint16_t addr) const
 {
-	bool port1 = (addr & 0x100) != 0;
-	return regs_[(port1 ? 256 : 0) + (addr & 0xFF)];
+	return regs_[index(addr)];
 }
 
 void OPL3State::write(uint16_t addr, uint8_t data)
 {
-	bool port1 = (addr & 0x100) != 0;
-	regs_[(port1 ? 256 : 0) + (addr & 0xFF)] = data;
+	size_t idx = index(addr);
+	if (elide_ && regs_[idx] == data && is_known(idx) && !is_strobe(addr)) {
+		elided_writes_++;
+		return;
+	}
+	write_force(addr, data);
+}
+
+void OPL3State::write_force(uint16_t addr, uint8_t data)
+{
+	size_t idx = index(addr);
+	regs_[idx] = data;
+	known_[idx >> 6] |= uint64_t(1) << (idx & 63);
 	hw_.queue(addr, data);
 }
 
@@ -46,40 +65,44 @@ void OPL3State::modify_bits(uint16_t addr, uint8_t mask, uint8_t value)
 	write(addr, updated);
 }
 
+void OPL3State::invalidate()
+{
+	std::memset(known_, 0, sizeof(known_));
+}
+
 void OPL3State::reset()
 {
 	std::memset(regs_, 0, sizeof(regs_));
+	invalidate();
 
-	// OPL3 init sequence (matches RetroWaveOPL3 constructor)
-	hw_.queue(0x004, 96);
-	hw_.queue(0x004, 128);
-	hw_.queue(0x105, 0x00);
-	hw_.queue(0x105, 0x01);
-	hw_.queue(0x105, 0x00);
-	hw_.queue(0x001, 32);
-	hw_.queue(0x105, 0x01);
-
-	regs_[256 + 0x05] = 0x01; // Track OPL3 enable in shadow
+	// OPL3 init sequence: reset timers, toggle and enable OPL3 mode
+	write_force(0x004, 96);
+	write_force(0x004, 128);
+	write_force(0x105, 0x00);
+	write_force(0x105, 0x01);
+	write_force(0x105, 0x00);
+	write_force(0x001, 32);
+	write_force(0x105, 0x01);
 
 	// Clear all operator and channel registers
 	for (int port = 0; port < 2; ++port) {
 		uint16_t base = port ? 0x100 : 0x000;
 		for (uint8_t reg = 0x20; reg <= 0x35; ++reg)
-			hw_.queue(base | reg, 0);
+			write_force(base | reg, 0);
 		for (uint8_t reg = 0x40; reg <= 0x55; ++reg)
-			hw_.queue(base | reg, 0x3F); // Max attenuation
+			write_force(base | reg, 0x3F); // Max attenuation
 		for (uint8_t reg = 0x60; reg <= 0x75; ++reg)
-			hw_.queue(base | reg, 0);
+			write_force(base | reg, 0);
 		for (uint8_t reg = 0x80; reg <= 0x95; ++reg)
-			hw_.queue(base | reg, 0x0F); // Fastest release
+			write_force(base | reg, 0x0F); // Fastest release
 		for (uint8_t reg = 0xA0; reg <= 0xA8; ++reg)
-			hw_.queue(base | reg, 0);
+			write_force(base | reg, 0);
 		for (uint8_t reg = 0xB0; reg <= 0xB8; ++reg)
-			hw_.queue(base | reg, 0); // Key-off, zero freq
+			write_force(base | reg, 0); // Key-off, zero freq
 		for (uint8_t reg = 0xC0; reg <= 0xC8; ++reg)
-			hw_.queue(base | reg, 0x30); // Both speakers on
+			write_force(base | reg, 0x30); // Both speakers on
 		for (uint8_t reg = 0xE0; reg <= 0xF5; ++reg)
-			hw_.queue(base | reg, 0);
+			write_force(base | reg, 0);
 	}
 }
 
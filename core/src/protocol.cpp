@@ -19,9 +19,88 @@
 
 #include <retrowave/protocol.h>
 
+#include <cstring>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 namespace retrowave {
 
+// Load 7 bytes as a big-endian 56-bit value.
+static inline uint64_t load_be56(const uint8_t *p)
+{
+	return (uint64_t(p[0]) << 48) | (uint64_t(p[1]) << 40) |
+	       (uint64_t(p[2]) << 32) | (uint64_t(p[3]) << 24) |
+	       (uint64_t(p[4]) << 16) | (uint64_t(p[5]) << 8) |
+	       uint64_t(p[6]);
+}
+
+// Store v big-endian: one 64-bit store, byte-swapped first on
+// little-endian hosts.
+static inline void store_be64(uint8_t *p, uint64_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	std::memcpy(p, &v, 8);
+}
+
+// Spread 8 groups of 7 bits into the top 7 bits of each byte, set bit 0.
+// The portable form is written out term by term so it does not rely on
+// the optimizer unrolling a loop.
+static inline uint64_t pack_block(uint64_t v)
+{
+#if defined(__BMI2__)
+	return _pdep_u64(v, 0xFEFEFEFEFEFEFEFEull) | 0x0101010101010101ull;
+#else
+	return ((v << 8) & 0xFE00000000000000ull) |
+	       ((v << 7) & 0x00FE000000000000ull) |
+	       ((v << 6) & 0x0000FE0000000000ull) |
+	       ((v << 5) & 0x000000FE00000000ull) |
+	       ((v << 4) & 0x00000000FE000000ull) |
+	       ((v << 3) & 0x0000000000FE0000ull) |
+	       ((v << 2) & 0x000000000000FE00ull) |
+	       ((v << 1) & 0x00000000000000FEull) |
+	       0x0101010101010101ull;
+#endif
+}
+
+static inline void pack_block_to(const uint8_t *in7, uint8_t *out8)
+{
+	store_be64(out8, pack_block(load_be56(in7)));
+}
+
 size_t protocol_serial_pack(const uint8_t *buf_in, size_t len_in, uint8_t *buf_out)
+{
+	uint8_t *out = buf_out;
+	*out++ = 0x00;
+
+	size_t full = len_in / 7;
+	for (size_t b = 0; b < full; ++b) {
+		pack_block_to(buf_in, out);
+		buf_in += 7;
+		out += 8;
+	}
+
+	// A partial block of r bytes packs like a zero-padded block, of which
+	// only the first r + 1 output bytes are sent.
+	size_t rem = len_in - full * 7;
+	if (rem) {
+		uint8_t tail[7] = {};
+		std::memcpy(tail, buf_in, rem);
+		uint8_t packed[8];
+		pack_block_to(tail, packed);
+		std::memcpy(out, packed, rem + 1);
+		out += rem + 1;
+	}
+
+	*out++ = 0x02;
+
+	return static_cast<size_t>(out - buf_out);
+}
+
+size_t protocol_serial_pack_ref(const uint8_t *buf_in, size_t len_in, uint8_t *buf_out)
 {
 	size_t in_cursor = 0;
 	size_t out_cursor = 0;
@@ -60,4 +139,180 @@ size_t protocol_serial_pack(const uint8_t *buf_in, size_t len_in, uint8_t *buf_o
 	return out_cursor;
 }
 
+bool protocol_serial_unpack(const uint8_t *buf_in, size_t len_in, std::vector<uint8_t> &out)
+{
+	if (len_in < 2 || buf_in[0] != 0x00 || buf_in[len_in - 1] != 0x02)
+		return false;
+
+	uint32_t acc = 0;
+	unsigned bits = 0;
+	for (size_t i = 1; i + 1 < len_in; ++i) {
+		uint8_t b = buf_in[i];
+		if (!(b & 0x01))
+			return false;
+		acc = (acc << 7) | (b >> 1);
+		bits += 7;
+		if (bits >= 8) {
+			bits -= 8;
+			out.push_back(static_cast<uint8_t>(acc >> bits));
+		}
+	}
+	// Leftover bits are padding from the last partial group
+	return true;
+}
+
+// --- ProtocolDecoder ---
+
+void ProtocolDecoder::reset()
+{
+	raw_.clear();
+	in_frame_ = false;
+	bad_ = false;
+	acc_ = 0;
+	bits_ = 0;
+}
+
+void ProtocolDecoder::feed(const uint8_t *data, size_t len, const FrameFn &fn)
+{
+	for (size_t i = 0; i < len; ++i) {
+		uint8_t b = data[i];
+
+		if (b == 0x00) {
+			// Start of frame (also resyncs after a truncated one)
+			reset();
+			in_frame_ = true;
+			continue;
+		}
+		if (!in_frame_)
+			continue;
+
+		if (b == 0x02) {
+			if (bad_)
+				malformed_++;
+			else if (fn)
+				fn(raw_.data(), raw_.size());
+			reset();
+			continue;
+		}
+
+		if (!(b & 0x01)) {
+			bad_ = true;
+			continue;
+		}
+		acc_ = (acc_ << 7) | (b >> 1);
+		bits_ += 7;
+		if (bits_ >= 8) {
+			bits_ -= 8;
+			raw_.push_back(static_cast<uint8_t>(acc_ >> bits_));
+		}
+	}
+}
+
+// --- Register stream parser ---
+
+bool protocol_parse_opl3(const uint8_t *raw, size_t len, std::vector<OPL3RegWrite> &out)
+{
+	if (len < 2 || raw[0] != (0x21 << 1) || raw[1] != 0x12)
+		return false;
+
+	// The stream is pairs of (control, bus) bytes: 0xe1/0xe5 latches the
+	// register address on port 0/1, 0xe3/0xe7 writes the data byte, and
+	// 0xfb releases the write strobe.
+	uint16_t addr = 0;
+	bool have_addr = false;
+	for (size_t i = 2; i + 1 < len; i += 2) {
+		uint8_t ctrl = raw[i];
+		uint8_t bus = raw[i + 1];
+		switch (ctrl) {
+		case 0xe1:
+		case 0xe5:
+			addr = static_cast<uint16_t>((ctrl == 0xe5 ? 0x100 : 0x000) | bus);
+			have_addr = true;
+			break;
+		case 0xe3:
+		case 0xe7:
+			if (!have_addr || ((ctrl == 0xe7) != ((addr & 0x100) != 0)))
+				return false;
+			out.push_back({addr, bus});
+			break;
+		case 0xfb:
+			break;
+		default:
+			return false;
+		}
+	}
+	return (len & 1) == 0;
+}
+
+// --- ProtocolPacker ---
+
+ProtocolPacker::ProtocolPacker(size_t reserve_raw)
+{
+	raw_.reserve(reserve_raw);
+	ensure_out(reserve_raw);
+	reset();
+}
+
+void ProtocolPacker::ensure_out(size_t raw_len)
+{
+	// Start byte, 8 bytes per (partial) block, trailer
+	size_t need = 1 + (raw_len + 6) / 7 * 8 + 1;
+	if (out_.size() < need)
+		out_.resize(need * 2);
+}
+
+void ProtocolPacker::reset()
+{
+	raw_.clear();
+	sealed_ = 0;
+	out_[0] = 0x00;
+}
+
+void ProtocolPacker::append(const uint8_t *data, size_t len)
+{
+	raw_.insert(raw_.end(), data, data + len);
+	ensure_out(raw_.size());
+
+	while (sealed_ + 7 <= raw_.size()) {
+		pack_block_to(raw_.data() + sealed_, out_.data() + 1 + sealed_ / 7 * 8);
+		sealed_ += 7;
+	}
+}
+
+void ProtocolPacker::update(size_t raw_offset, uint8_t value)
+{
+	raw_[raw_offset] = value;
+	if (raw_offset < sealed_) {
+		size_t block = raw_offset / 7;
+		pack_block_to(raw_.data() + block * 7, out_.data() + 1 + block * 8);
+	}
+}
+
+void ProtocolPacker::truncate(size_t raw_len)
+{
+	raw_.resize(raw_len);
+	// A block cut short is packed again by append() or finish()
+	if (sealed_ > raw_len)
+		sealed_ = raw_len / 7 * 7;
+}
+
+size_t ProtocolPacker::finish()
+{
+	uint8_t *out = out_.data() + 1 + sealed_ / 7 * 8;
+
+	size_t rem = raw_.size() - sealed_;
+	if (rem) {
+		uint8_t tail[7] = {};
+		std::memcpy(tail, raw_.data() + sealed_, rem);
+		uint8_t packed[8];
+		pack_block_to(tail, packed);
+		std::memcpy(out, packed, rem + 1);
+		out += rem + 1;
+	}
+
+	*out++ = 0x02;
+
+	return static_cast<size_t>(out - out_.data());
+}
+
 } // namespace retrowave
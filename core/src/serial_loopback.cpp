@@ -0,0 +1,153 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <retrowave/serial_loopback.h>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace retrowave {
+
+bool LoopbackSerialPort::open(const std::string &)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	open_ = true;
+	epoch_ = clock::now();
+	link_free_ns_ = 0;
+	decoder_.reset();
+	return true;
+}
+
+void LoopbackSerialPort::close()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	open_ = false;
+}
+
+bool LoopbackSerialPort::is_open() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return open_;
+}
+
+uint64_t LoopbackSerialPort::now_ns() const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - epoch_).count();
+}
+
+bool LoopbackSerialPort::write(const uint8_t *data, size_t len)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!open_)
+		return false;
+
+	// Link model: frames are serialised back to back at the configured rate
+	uint64_t start = std::max(now_ns(), link_free_ns_);
+	uint64_t tx_ns = bandwidth_ ? len * 1000000000ull / bandwidth_ : 0;
+	link_free_ns_ = start + tx_ns;
+	uint64_t arrival = link_free_ns_ + latency_ns_;
+
+	stats_.bytes += len;
+	stats_.link_busy_ns += tx_ns;
+
+	decoder_.feed(data, len, [&](const uint8_t *raw, size_t raw_len) {
+		stats_.frames++;
+		scratch_.clear();
+		if (!protocol_parse_opl3(raw, raw_len, scratch_))
+			stats_.malformed_frames++;
+		for (const auto &w : scratch_) {
+			regs_[w.addr & 0x1FF] = w.value;
+			if (logging_)
+				log_.push_back({arrival, w.addr, w.value});
+		}
+		stats_.writes += scratch_.size();
+	});
+
+	if (timing_ == Timing::Realtime && tx_ns) {
+		auto until = epoch_ + std::chrono::nanoseconds(link_free_ns_);
+		lock.unlock();
+		std::this_thread::sleep_until(until);
+	}
+	return true;
+}
+
+// --- Link model ---
+
+void LoopbackSerialPort::set_bandwidth(uint64_t bytes_per_sec)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	bandwidth_ = bytes_per_sec;
+}
+
+void LoopbackSerialPort::set_latency(std::chrono::nanoseconds latency)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	latency_ns_ = latency.count() > 0 ? static_cast<uint64_t>(latency.count()) : 0;
+}
+
+void LoopbackSerialPort::set_timing(Timing timing)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	timing_ = timing;
+}
+
+void LoopbackSerialPort::set_logging(bool enabled)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	logging_ = enabled;
+}
+
+// --- Inspection ---
+
+uint8_t LoopbackSerialPort::reg(uint16_t addr) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return regs_[addr & 0x1FF];
+}
+
+std::vector<uint8_t> LoopbackSerialPort::registers() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return std::vector<uint8_t>(regs_, regs_ + sizeof(regs_));
+}
+
+std::vector<LoopbackSerialPort::LogEntry> LoopbackSerialPort::log() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return log_;
+}
+
+LoopbackSerialPort::Stats LoopbackSerialPort::stats() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	Stats s = stats_;
+	s.malformed_frames += decoder_.malformed_frames();
+	return s;
+}
+
+void LoopbackSerialPort::reset()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::memset(regs_, 0, sizeof(regs_));
+	log_.clear();
+	stats_ = Stats();
+	decoder_ = ProtocolDecoder();
+	link_free_ns_ = 0;
+}
+
+} // namespace retrowave
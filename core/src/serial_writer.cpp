@@ -0,0 +1,148 @@
+/*
+    This file is part of RetroWaveMIDIProxy
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as
+    published by the Free Software Foundation, either version 3 of the
+    License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <retrowave/serial_writer.h>
+
+#include <chrono>
+
+namespace retrowave {
+
+static size_t round_up_pow2(size_t n)
+{
+	size_t p = 1;
+	while (p < n)
+		p <<= 1;
+	return p;
+}
+
+SerialWriter::SerialWriter(SerialPort &serial, size_t slots)
+	: serial_(serial)
+{
+	slots_.resize(round_up_pow2(slots < 2 ? 2 : slots));
+	mask_ = slots_.size() - 1;
+	for (auto &s : slots_)
+		s.reserve(1024);
+}
+
+SerialWriter::~SerialWriter()
+{
+	stop();
+}
+
+void SerialWriter::start()
+{
+	if (running())
+		return;
+	stop_ = false;
+	running_ = true;
+	thread_ = std::thread(&SerialWriter::thread_main, this);
+}
+
+void SerialWriter::stop()
+{
+	if (!thread_.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lk(wake_mutex_);
+		stop_ = true;
+	}
+	wake_cv_.notify_one();
+	thread_.join();
+	running_ = false;
+}
+
+void SerialWriter::submit(const uint8_t *data, size_t len)
+{
+	// Not started yet (e.g. the OPL3 init frame): write synchronously.
+	if (!running()) {
+		if (!serial_.write(data, len))
+			write_errors_.fetch_add(1, std::memory_order_relaxed);
+		frames_.fetch_add(1, std::memory_order_relaxed);
+		bytes_.fetch_add(len, std::memory_order_relaxed);
+		return;
+	}
+
+	size_t tail = tail_.load(std::memory_order_relaxed);
+	if (tail - head_.load(std::memory_order_acquire) > mask_) {
+		ring_full_stalls_.fetch_add(1, std::memory_order_relaxed);
+		while (tail - head_.load(std::memory_order_acquire) > mask_)
+			std::this_thread::yield();
+	}
+
+	slots_[tail & mask_].assign(data, data + len);
+	tail_.store(tail + 1, std::memory_order_seq_cst);
+
+	size_t occ = tail + 1 - head_.load(std::memory_order_relaxed);
+	if (occ > max_occupancy_.load(std::memory_order_relaxed))
+		max_occupancy_.store(occ, std::memory_order_relaxed);
+
+	if (sleeping_.load(std::memory_order_seq_cst)) {
+		{ std::lock_guard<std::mutex> lk(wake_mutex_); }
+		wake_cv_.notify_one();
+	}
+}
+
+void SerialWriter::thread_main()
+{
+	using clock = std::chrono::steady_clock;
+
+	for (;;) {
+		size_t head = head_.load(std::memory_order_relaxed);
+
+		if (head == tail_.load(std::memory_order_acquire)) {
+			std::unique_lock<std::mutex> lk(wake_mutex_);
+			sleeping_.store(true, std::memory_order_seq_cst);
+			wake_cv_.wait(lk, [&] {
+				return stop_.load() || head != tail_.load(std::memory_order_seq_cst);
+			});
+			sleeping_.store(false, std::memory_order_relaxed);
+			if (head == tail_.load(std::memory_order_acquire))
+				return; // stop requested and ring drained
+			continue;
+		}
+
+		const auto &frame = slots_[head & mask_];
+		auto t0 = clock::now();
+		bool ok = serial_.write(frame.data(), frame.size());
+		auto dt = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count();
+
+		if (!ok)
+			write_errors_.fetch_add(1, std::memory_order_relaxed);
+		if (static_cast<uint64_t>(dt) > kSlowWriteNs)
+			slow_writes_.fetch_add(1, std::memory_order_relaxed);
+		frames_.fetch_add(1, std::memory_order_relaxed);
+		bytes_.fetch_add(frame.size(), std::memory_order_relaxed);
+
+		head_.store(head + 1, std::memory_order_release);
+	}
+}
+
+SerialWriter::Stats SerialWriter::stats() const
+{
+	Stats s;
+	s.occupancy = tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+	s.max_occupancy = max_occupancy_.load(std::memory_order_relaxed);
+	s.capacity = slots_.size();
+	s.frames = frames_.load(std::memory_order_relaxed);
+	s.bytes = bytes_.load(std::memory_order_relaxed);
+	s.ring_full_stalls = ring_full_stalls_.load(std::memory_order_relaxed);
+	s.slow_writes = slow_writes_.load(std::memory_order_relaxed);
+	s.write_errors = write_errors_.load(std::memory_order_relaxed);
+	return s;
+}
+
+} // namespace retrowave
@@ -17,20 +17,26 @@
 
 #include <retrowave/voice_allocator.h>
 #include <retrowave/opl3_registers.h>
-#include <cmath>
 #include <algorithm>
-#include <limits>
 
 namespace retrowave {
 
 using namespace opl3;
 
 VoiceAllocator::VoiceAllocator(DirectMode &dm, OPL3State &state, uint8_t device_id)
-	: dm_(dm), state_(state), device_id_(device_id)
+	: dm_(dm), state_(state), cards_{&dm}, device_id_(device_id)
 {
 	init_default_mapping();
 }
 
+bool VoiceAllocator::add_card(DirectMode &dm)
+{
+	if (cards_.size() >= kMaxCards)
+		return false;
+	cards_.push_back(&dm);
+	return true;
+}
+
 void VoiceAllocator::init_default_mapping()
 {
 	for (int i = 0; i < 16; ++i) {
@@ -42,9 +48,11 @@ void VoiceAllocator::init_default_mapping()
 		mcs.config.detune_cents = 10;
 		mcs.config.four_op = false;
 
-		mcs.voices.resize(mcs.config.opl3_channels.size());
-		for (auto &v : mcs.voices)
-			v = Voice{};
+		set_pool(mcs);
+		mcs.sounding.clear();
+		mcs.sustained.clear();
+		mcs.lru_head = mcs.lru_tail = kNone;
+		mcs.note_leader.fill(kNone);
 
 		mcs.volume = 100;
 		mcs.expression = 127;
@@ -54,20 +62,19 @@ void VoiceAllocator::init_default_mapping()
 		mcs.sustain = false;
 		mcs.pitch_bend = 8192;
 	}
+	for (auto &v : voices_)
+		v = Voice{};
+	busy_.clear();
+	patch_owner_.fill(kNone);
+	if (pool_mode_ == PoolMode::Dynamic)
+		enter_dynamic();
 }
 
 void VoiceAllocator::reset()
 {
 	// Release all sounding notes
-	for (int midi_ch = 0; midi_ch < 16; ++midi_ch) {
-		auto &mcs = midi_channels_[midi_ch];
-		for (size_t i = 0; i < mcs.voices.size(); ++i) {
-			if (mcs.voices[i].note >= 0) {
-				dm_.release_note_on_channel(mcs.config.opl3_channels[i]);
-				mcs.voices[i] = Voice{};
-			}
-		}
-	}
+	for (auto &mcs : midi_channels_)
+		release_all(mcs);
 	// Release any sounding drums
 	for (int d = 0; d < DirectMode::kNumDrums; ++d) {
 		if (drum_sounding_note_[d] >= 0) {
@@ -75,7 +82,6 @@ void VoiceAllocator::reset()
 			drum_sounding_note_[d] = -1;
 		}
 	}
-	timestamp_counter_ = 0;
 }
 
 void VoiceAllocator::set_percussion_mode(bool enabled)
@@ -86,6 +92,14 @@ void VoiceAllocator::set_percussion_mode(bool enabled)
 	// Toggle the OPL3 percussion mode register via NRPN
 	dm_.direct_nrpn(0, 5, 2, enabled ? 127 : 0);
 
+	// The drum channels leave the dynamic pool
+	if (enabled && pool_mode_ == PoolMode::Dynamic) {
+		for (uint8_t ch = 6; ch <= 8; ++ch) {
+			if (busy_.test(ch))
+				release_voice(midi_channels_[voices_[ch].owner], ch);
+		}
+	}
+
 	if (!enabled) {
 		// Release all sounding drums
 		for (int d = 0; d < DirectMode::kNumDrums; ++d) {
@@ -120,43 +134,45 @@ void VoiceAllocator::set_voice_config(uint8_t midi_ch, const VoiceConfig &config
 	auto &mcs = midi_channels_[midi_ch];
 
 	// Release all sounding notes on the old config
-	for (size_t i = 0; i < mcs.voices.size(); ++i) {
-		if (mcs.voices[i].note >= 0)
-			dm_.release_note_on_channel(mcs.config.opl3_channels[i]);
+	release_all(mcs);
+
+	VoiceMask claimed;
+	for (uint8_t opl3_ch : config.opl3_channels) {
+		if (opl3_ch < channel_count())
+			claimed.set(opl3_ch);
 	}
 
 	// Deconflict: remove claimed channels from any other MIDI channel
-	for (uint8_t opl3_ch : config.opl3_channels) {
-		for (int other = 0; other < 16; ++other) {
-			if (other == midi_ch) continue;
-			auto &other_mcs = midi_channels_[other];
-			auto it = std::find(other_mcs.config.opl3_channels.begin(),
-			                    other_mcs.config.opl3_channels.end(), opl3_ch);
-			if (it != other_mcs.config.opl3_channels.end()) {
-				size_t idx = static_cast<size_t>(it - other_mcs.config.opl3_channels.begin());
-				// Release any note on this slot
-				if (idx < other_mcs.voices.size() && other_mcs.voices[idx].note >= 0)
-					dm_.release_note_on_channel(opl3_ch);
-				other_mcs.config.opl3_channels.erase(it);
-				if (idx < other_mcs.voices.size())
-					other_mcs.voices.erase(other_mcs.voices.begin() + static_cast<long>(idx));
-			}
+	for (int other = 0; other < 16; ++other) {
+		if (other == midi_ch) continue;
+		auto &other_mcs = midi_channels_[other];
+		VoiceMask taken = other_mcs.pool & claimed;
+		if (taken.none()) continue;
+		for (int ch = taken.first(); ch >= 0; ch = taken.next(ch)) {
+			// Release any note on this slot
+			if (other_mcs.sounding.test(ch))
+				release_voice(other_mcs, static_cast<uint8_t>(ch));
 		}
+		auto &chs = other_mcs.config.opl3_channels;
+		chs.erase(std::remove_if(chs.begin(), chs.end(),
+		                         [&](uint8_t ch) { return taken.test(ch); }),
+		          chs.end());
+		set_pool(other_mcs);
 	}
 
 	mcs.config = config;
-	mcs.voices.resize(config.opl3_channels.size());
-	for (auto &v : mcs.voices)
-		v = Voice{};
+	set_pool(mcs);
+
+	// In dynamic mode the pool only takes effect when switching back
+	if (pool_mode_ == PoolMode::Dynamic)
+		return;
 
 	// Apply current MIDI state to all newly assigned OPL3 channels
-	for (uint8_t opl3_ch : config.opl3_channels) {
-		dm_.apply_cc_to_channel(opl3_ch, 7, mcs.volume);
-		dm_.apply_cc_to_channel(opl3_ch, 11, mcs.expression);
-		dm_.apply_cc_to_channel(opl3_ch, 10, mcs.pan);
-		dm_.apply_cc_to_channel(opl3_ch, 1, mcs.mod_wheel);
-		dm_.apply_cc_to_channel(opl3_ch, 74, mcs.brightness);
-	}
+	cc_voices(claimed, 7, mcs.volume);
+	cc_voices(claimed, 11, mcs.expression);
+	cc_voices(claimed, 10, mcs.pan);
+	cc_voices(claimed, 1, mcs.mod_wheel);
+	cc_voices(claimed, 74, mcs.brightness);
 }
 
 const VoiceConfig &VoiceAllocator::voice_config(uint8_t midi_ch) const
@@ -170,33 +186,26 @@ int VoiceAllocator::poly_voice_count(uint8_t midi_ch) const
 	const auto &mcs = midi_channels_[midi_ch];
 	int unison = std::max<int>(mcs.config.unison_count, 1);
 
+	if (pool_mode_ == PoolMode::Dynamic) {
+		int slots = dynamic_pool().count();
+		if (mcs.limits.max_voices)
+			slots = std::min<int>(slots, mcs.limits.max_voices);
+		return slots / unison;
+	}
+
+	int slots = mcs.pool.count();
+
 	if (mcs.config.four_op) {
 		// Count 4-op pairs as 1 voice slot, standalone channels as 1 slot
-		int slots = 0;
-		std::vector<bool> counted(mcs.config.opl3_channels.size(), false);
-		for (size_t i = 0; i < mcs.config.opl3_channels.size(); ++i) {
-			if (counted[i]) continue;
-			uint8_t ch = mcs.config.opl3_channels[i];
-			int partner = four_op_partner(ch);
-			bool found_partner = false;
-			if (partner >= 0) {
-				for (size_t j = i + 1; j < mcs.config.opl3_channels.size(); ++j) {
-					if (!counted[j] && mcs.config.opl3_channels[j] == static_cast<uint8_t>(partner)) {
-						counted[j] = true;
-						found_partner = true;
-						break;
-					}
-				}
-			}
-			counted[i] = true;
-			slots++;
-			(void)found_partner; // pair counts as 1 regardless
+		for (int ch = mcs.pool.first(); ch >= 0; ch = mcs.pool.next(ch)) {
+			int local = card_channel(static_cast<uint8_t>(ch));
+			int partner = four_op_partner(local);
+			if (partner > local && mcs.pool.test(ch - local + partner))
+				slots--;
 		}
-		return slots / unison;
 	}
 
-	int pool = static_cast<int>(mcs.config.opl3_channels.size());
-	return pool / unison;
+	return slots / unison;
 }
 
 void VoiceAllocator::process_midi(const uint8_t *data, size_t len)
@@ -208,19 +217,23 @@ void VoiceAllocator::process_midi(const uint8_t *data, size_t len)
 		if (len >= 5 && data[1] == kSysExManufID) {
 			uint8_t cmd = data[3];
 			if (cmd == kSysExVoiceConfig || cmd == kSysExVoiceQuery ||
-			    cmd == kSysExPercConfig || cmd == kSysExPercQuery) {
+			    cmd == kSysExPercConfig || cmd == kSysExPercQuery ||
+			    cmd == kSysExPoolConfig || cmd == kSysExPoolQuery) {
 				handle_sysex(data, len);
 				return;
 			}
 			// Intercept ResetAll to also reset voice allocator state
 			if (cmd == kSysExResetAll) {
 				reset();
-				dm_.process_midi(data, len);
+				forward_sysex(data, len);
+				// Every channel now has the default patch
+				if (pool_mode_ == PoolMode::Dynamic)
+					enter_dynamic();
 				return;
 			}
 		}
 		// Forward other SysEx to DirectMode
-		dm_.process_midi(data, len);
+		forward_sysex(data, len);
 		return;
 	}
 
@@ -258,87 +271,58 @@ void VoiceAllocator::process_midi(const uint8_t *data, size_t len)
 
 void VoiceAllocator::handle_note_on(uint8_t midi_ch, uint8_t note, uint8_t vel)
 {
-	if (midi_ch >= 16) return;
+	if (midi_ch >= 16 || note > 127) return;
 
 	// Check percussion routing first
 	if (try_perc_note_on(midi_ch, note, vel)) return;
 
 	auto &mcs = midi_channels_[midi_ch];
-	if (mcs.config.opl3_channels.empty()) return;
+	bool dynamic = pool_mode_ == PoolMode::Dynamic;
+	if (!dynamic && mcs.pool.none()) return;
 
 	int unison = std::max<int>(mcs.config.unison_count, 1);
 
 	// If this note is already playing, release the old voices first
-	for (size_t i = 0; i < mcs.voices.size(); ++i) {
-		if (mcs.voices[i].note == static_cast<int8_t>(note)) {
-			dm_.release_note_on_channel(mcs.config.opl3_channels[i]);
-			mcs.voices[i] = Voice{};
-		}
-	}
+	if (mcs.note_leader[note] != kNone)
+		release_group(mcs, static_cast<uint8_t>(mcs.note_leader[note]));
 
 	// Allocate voice slots
-	auto result = allocate_slots(mcs, unison);
-	if (result.slot_indices.empty()) return;
-
-	uint64_t ts = ++timestamp_counter_;
-
-	for (int idx = 0; idx < static_cast<int>(result.slot_indices.size()); ++idx) {
-		int slot = result.slot_indices[idx];
-		uint8_t opl3_ch = mcs.config.opl3_channels[slot];
-
-		uint16_t f_num;
-		uint8_t block;
-		if (unison > 1) {
-			compute_detuned_freq(note, idx, unison, mcs.config.detune_cents, f_num, block);
-		} else {
-			const auto &nf = note_freq(note);
-			f_num = nf.f_num;
-			block = nf.block;
-		}
+	auto result = dynamic ? allocate_dynamic(midi_ch, unison) : allocate_slots(mcs, unison);
+	if (result.voices.none()) return;
 
-		// Apply pitch bend if active
-		if (mcs.pitch_bend != 8192) {
-			double range = mcs.bend_range_semitones + mcs.bend_range_cents / 100.0;
-			double semitones = (static_cast<int>(mcs.pitch_bend) - 8192) * range / 8192.0;
-			double freq = 440.0 * std::pow(2.0, (note - 69.0 + semitones) / 12.0);
-
-			// Apply unison detune on top of bend
-			if (unison > 1) {
-				double cents_offset = 0;
-				if (unison > 1)
-					cents_offset = (idx - (unison - 1) / 2.0) * mcs.config.detune_cents / (unison - 1);
-				freq *= std::pow(2.0, cents_offset / 1200.0);
-			}
+	start_group(mcs, note, result.voices);
+	for (int ch = result.voices.first(); ch >= 0; ch = result.voices.next(ch))
+		voices_[ch].owner = midi_ch;
 
-			static constexpr double kOPL3FreqBase = 49716.0;
-			f_num = 0;
-			block = 0;
-			for (int b = 0; b < 8; ++b) {
-				double divisor = kOPL3FreqBase / static_cast<double>(1 << (20 - b));
-				int fn = static_cast<int>(freq / divisor + 0.5);
-				if (fn <= 1023) {
-					if (fn < 0) fn = 0;
-					f_num = static_cast<uint16_t>(fn);
-					block = static_cast<uint8_t>(b);
-					break;
-				}
-				if (b == 7) { f_num = 1023; block = 7; }
-			}
-		}
+	// The bent pitch is the same for every voice of the note
+	int32_t pitch = note * kPitchSteps +
+		bend_pitch(mcs.pitch_bend, mcs.bend_range_semitones, mcs.bend_range_cents);
+
+	for (int idx = 0; idx < result.count; ++idx) {
+		uint8_t opl3_ch = result.order[idx];
+		int ch = opl3_ch;
+		auto &voice = voices_[ch];
+
+		// A channel taken over from another MIDI channel gets our patch
+		if (dynamic && patch_owner_[ch] != static_cast<int8_t>(midi_ch))
+			take_patch(opl3_ch, midi_ch);
+
+		// Kept per voice so bends only add to it
+		voice.unison_idx = static_cast<uint8_t>(idx);
+		voice.detune = detune_pitch(idx, unison, mcs.config.detune_cents);
+
+		// Pitch bend and unison detune on top of the note
+		NoteFreq nf = pitch_freq(pitch + voice.detune);
 
-		auto &voice = mcs.voices[slot];
-		voice.note = static_cast<int8_t>(note);
 		voice.velocity = vel;
-		voice.timestamp = ts;
-		voice.detuned_fnum = f_num;
-		voice.detuned_block = block;
-		voice.sustained = false;
+		voice.detuned_fnum = nf.f_num;
+		voice.detuned_block = nf.block;
 
-		dm_.play_note_on_channel(opl3_ch, note, vel);
+		play_channel(opl3_ch, note, vel);
 
 		// If detuned or bent, overwrite the frequency
 		if (unison > 1 || mcs.pitch_bend != 8192) {
-			dm_.bend_channel(opl3_ch, f_num, block);
+			bend_channel(opl3_ch, nf.f_num, nf.block);
 		}
 
 		// Apply stereo pan split for unison voices
@@ -364,7 +348,7 @@ void VoiceAllocator::handle_note_on(uint8_t midi_ch, uint8_t note, uint8_t vel)
 					pan_val = static_cast<uint8_t>(64 + (idx - center_idx) * 63 / (unison - 1 - center_idx));
 				}
 			}
-			dm_.apply_cc_to_channel(opl3_ch, 10, pan_val);
+			cc_channel(opl3_ch, 10, pan_val);
 		}
 	}
 }
@@ -373,23 +357,19 @@ void VoiceAllocator::handle_note_on(uint8_t midi_ch, uint8_t note, uint8_t vel)
 
 void VoiceAllocator::handle_note_off(uint8_t midi_ch, uint8_t note)
 {
-	if (midi_ch >= 16) return;
+	if (midi_ch >= 16 || note > 127) return;
 
 	// Check percussion routing first
 	if (try_perc_note_off(midi_ch, note)) return;
 
 	auto &mcs = midi_channels_[midi_ch];
+	int8_t leader = mcs.note_leader[note];
+	if (leader == kNone) return;
 
-	for (size_t i = 0; i < mcs.voices.size(); ++i) {
-		if (mcs.voices[i].note == static_cast<int8_t>(note)) {
-			if (mcs.sustain) {
-				mcs.voices[i].sustained = true;
-			} else {
-				dm_.release_note_on_channel(mcs.config.opl3_channels[i]);
-				mcs.voices[i] = Voice{};
-			}
-		}
-	}
+	if (mcs.sustain)
+		mcs.sustained |= voices_[leader].group;
+	else
+		release_group(mcs, static_cast<uint8_t>(leader));
 }
 
 // --- CC handling ---
@@ -411,12 +391,9 @@ void VoiceAllocator::handle_cc(uint8_t midi_ch, uint8_t cc, uint8_t val)
 		mcs.sustain = (val >= 64);
 		if (was_on && !mcs.sustain) {
 			// Release sustained notes
-			for (size_t i = 0; i < mcs.voices.size(); ++i) {
-				if (mcs.voices[i].sustained) {
-					dm_.release_note_on_channel(mcs.config.opl3_channels[i]);
-					mcs.voices[i] = Voice{};
-				}
-			}
+			VoiceMask held = mcs.sustained;
+			for (int ch = held.first(); ch >= 0; ch = held.next(ch))
+				release_voice(mcs, static_cast<uint8_t>(ch));
 		}
 		break;
 	}
@@ -432,9 +409,23 @@ void VoiceAllocator::handle_cc(uint8_t midi_ch, uint8_t cc, uint8_t val)
 	// Data Entry MSB
 	case 6:
 		if (mcs.nrpn_msb != 0x7F && mcs.nrpn_lsb != 0x7F) {
+			if (pool_mode_ == PoolMode::Dynamic) {
+				// Edit every channel carrying our patch (claim one if
+				// none does), then keep the copy used for new voices
+				if (mcs.patched.none()) {
+					VoiceMask v = allocate_dynamic(midi_ch, 1).voices;
+					if (v.none())
+						return;
+					take_patch(static_cast<uint8_t>(v.first()), midi_ch);
+				}
+				for (int ch = mcs.patched.first(); ch >= 0; ch = mcs.patched.next(ch))
+					nrpn_channel(static_cast<uint8_t>(ch), mcs.nrpn_msb, mcs.nrpn_lsb, val);
+				save_patch(midi_ch, static_cast<uint8_t>(mcs.patched.first()));
+				return;
+			}
 			// Forward NRPN to all assigned OPL3 channels
-			for (uint8_t opl3_ch : mcs.config.opl3_channels)
-				dm_.direct_nrpn(opl3_ch, mcs.nrpn_msb, mcs.nrpn_lsb, val);
+			for (int ch = mcs.pool.first(); ch >= 0; ch = mcs.pool.next(ch))
+				nrpn_channel(static_cast<uint8_t>(ch), mcs.nrpn_msb, mcs.nrpn_lsb, val);
 		} else if (mcs.rpn_msb == 0 && mcs.rpn_lsb == 0) {
 			// RPN 0x0000: Pitch Bend Sensitivity — semitones
 			mcs.bend_range_semitones = val;
@@ -456,9 +447,7 @@ void VoiceAllocator::handle_cc(uint8_t midi_ch, uint8_t cc, uint8_t val)
 	// (skip for NRPN/RPN addressing CCs — consumed above)
 	if (cc == 99 || cc == 98 || cc == 101 || cc == 100)
 		return;
-	for (uint8_t opl3_ch : mcs.config.opl3_channels) {
-		dm_.apply_cc_to_channel(opl3_ch, cc, val);
-	}
+	cc_voices(pool_mode_ == PoolMode::Dynamic ? mcs.patched : mcs.pool, cc, val);
 }
 
 // --- Pitch Bend ---
@@ -475,52 +464,23 @@ void VoiceAllocator::handle_pitch_bend(uint8_t midi_ch, uint16_t bend)
 void VoiceAllocator::recompute_bend(uint8_t midi_ch)
 {
 	auto &mcs = midi_channels_[midi_ch];
-	int unison = std::max<int>(mcs.config.unison_count, 1);
+	int32_t bend = bend_pitch(mcs.pitch_bend, mcs.bend_range_semitones, mcs.bend_range_cents);
 
-	// Recompute frequency for all sounding voices
-	for (size_t i = 0; i < mcs.voices.size(); ++i) {
-		auto &v = mcs.voices[i];
-		if (v.note < 0) continue;
-
-		double range = mcs.bend_range_semitones + mcs.bend_range_cents / 100.0;
-		double semitones = (static_cast<int>(mcs.pitch_bend) - 8192) * range / 8192.0;
-		double freq = 440.0 * std::pow(2.0, (v.note - 69.0 + semitones) / 12.0);
-
-		// Apply unison detune
-		if (unison > 1) {
-			// Find which unison index this voice is within its note group
-			int unison_idx = 0;
-			int count = 0;
-			for (size_t j = 0; j < mcs.voices.size(); ++j) {
-				if (mcs.voices[j].note == v.note && mcs.voices[j].timestamp == v.timestamp) {
-					if (j == i) { unison_idx = count; break; }
-					count++;
-				}
-			}
-			double cents_offset = 0;
-			if (unison > 1)
-				cents_offset = (unison_idx - (unison - 1) / 2.0) * mcs.config.detune_cents / (unison - 1);
-			freq *= std::pow(2.0, cents_offset / 1200.0);
-		}
+	// Recompute frequency for all sounding voices, one note group at a time
+	for (int8_t leader = mcs.lru_head; leader != kNone; leader = voices_[leader].next) {
+		const VoiceMask &group = voices_[leader].group;
+		int32_t pitch = voices_[leader].note * kPitchSteps + bend;
 
-		static constexpr double kOPL3FreqBase = 49716.0;
-		uint16_t f_num = 0;
-		uint8_t block = 0;
-		for (int b = 0; b < 8; ++b) {
-			double divisor = kOPL3FreqBase / static_cast<double>(1 << (20 - b));
-			int fn = static_cast<int>(freq / divisor + 0.5);
-			if (fn <= 1023) {
-				if (fn < 0) fn = 0;
-				f_num = static_cast<uint16_t>(fn);
-				block = static_cast<uint8_t>(b);
-				break;
-			}
-			if (b == 7) { f_num = 1023; block = 7; }
-		}
+		for (int ch = group.first(); ch >= 0; ch = group.next(ch)) {
+			auto &v = voices_[ch];
+
+			// Apply unison detune
+			NoteFreq nf = pitch_freq(pitch + v.detune);
 
-		v.detuned_fnum = f_num;
-		v.detuned_block = block;
-		dm_.bend_channel(mcs.config.opl3_channels[i], f_num, block);
+			v.detuned_fnum = nf.f_num;
+			v.detuned_block = nf.block;
+			bend_channel(static_cast<uint8_t>(ch), nf.f_num, nf.block);
+		}
 	}
 }
 
@@ -552,6 +512,12 @@ void VoiceAllocator::handle_sysex(const uint8_t *data, size_t len)
 	case kSysExPercQuery:
 		sysex_perc_query();
 		break;
+	case kSysExPoolConfig:
+		sysex_pool_config(payload, payload_len);
+		break;
+	case kSysExPoolQuery:
+		sysex_pool_query();
+		break;
 	default:
 		break;
 	}
@@ -571,7 +537,7 @@ void VoiceAllocator::sysex_voice_config(const uint8_t *data, size_t len)
 	VoiceConfig config;
 	for (uint8_t i = 0; i < count; ++i) {
 		uint8_t ch = data[2 + i];
-		if (ch < 18)
+		if (ch < channel_count())
 			config.opl3_channels.push_back(ch);
 	}
 	config.unison_count = data[2 + count];
@@ -612,101 +578,423 @@ void VoiceAllocator::sysex_voice_query(const uint8_t *data, size_t len)
 	midi_output_(msg);
 }
 
+void VoiceAllocator::forward_sysex(const uint8_t *data, size_t len)
+{
+	bool all_cards = len >= 5 && data[1] == kSysExManufID &&
+	                 (data[3] == kSysExResetAll || data[3] == kSysExHWReset);
+	if (!all_cards) {
+		dm_.process_midi(data, len);
+		return;
+	}
+	for (DirectMode *dm : cards_)
+		dm->process_midi(data, len);
+}
+
+// --- Multi-card addressing ---
+
+void VoiceAllocator::play_channel(uint8_t ch, uint8_t note, uint8_t vel)
+{
+	card(ch).play_note_on_channel(card_channel(ch), note, vel);
+}
+
+void VoiceAllocator::release_channel(uint8_t ch)
+{
+	card(ch).release_note_on_channel(card_channel(ch));
+}
+
+void VoiceAllocator::bend_channel(uint8_t ch, uint16_t f_num, uint8_t block)
+{
+	card(ch).bend_channel(card_channel(ch), f_num, block);
+}
+
+void VoiceAllocator::cc_channel(uint8_t ch, uint8_t cc, uint8_t val)
+{
+	card(ch).apply_cc_to_channel(card_channel(ch), cc, val);
+}
+
+void VoiceAllocator::cc_voices(const VoiceMask &voices, uint8_t cc, uint8_t val)
+{
+	// One call per card, with that card's channels as an 18-bit mask
+	for (size_t c = 0; c < cards_.size(); ++c) {
+		uint32_t mask = voices.bits(static_cast<int>(c) * kChannelsPerCard, kChannelsPerCard);
+		if (mask)
+			cards_[c]->apply_cc_to_channels(mask, cc, val);
+	}
+}
+
+void VoiceAllocator::nrpn_channel(uint8_t ch, uint8_t msb, uint8_t lsb, uint8_t val)
+{
+	card(ch).direct_nrpn(card_channel(ch), msb, lsb, val);
+}
+
 // --- Voice allocation helpers ---
 
+void VoiceAllocator::set_pool(MidiChannelState &mcs)
+{
+	mcs.pool.clear();
+	mcs.ascending = true;
+	int n = 0;
+	for (uint8_t ch : mcs.config.opl3_channels) {
+		if (ch >= channel_count() || mcs.pool.test(ch))
+			continue;
+		if (n > 0 && ch < mcs.order[n - 1])
+			mcs.ascending = false;
+		mcs.pool.set(ch);
+		mcs.rank[ch] = static_cast<uint8_t>(n);
+		mcs.order[n++] = ch;
+	}
+}
+
 VoiceAllocator::AllocResult VoiceAllocator::allocate_slots(MidiChannelState &mcs, int count)
 {
 	AllocResult result;
-	result.stolen = false;
 
-	// Find free slots
-	for (size_t i = 0; i < mcs.voices.size() && static_cast<int>(result.slot_indices.size()) < count; ++i) {
-		if (mcs.voices[i].note < 0)
-			result.slot_indices.push_back(static_cast<int>(i));
+	// Not enough free slots — steal oldest note group first
+	bool stole = (mcs.pool & ~mcs.sounding).count() < count;
+	if (stole)
+		steal_oldest_group(mcs, count);
+
+	// Free slots in the configured opl3_channels order, which sets each
+	// voice's unison index and pan-split side
+	VoiceMask free = mcs.pool & ~mcs.sounding;
+	if (mcs.ascending) {
+		for (int ch = free.first(); ch >= 0 && result.count < count; ch = free.next(ch))
+			result.add(ch);
+	} else {
+		VoiceMask ranks; // free slots by configured position
+		for (int ch = free.first(); ch >= 0; ch = free.next(ch))
+			ranks.set(mcs.rank[ch]);
+		for (int r = ranks.first(); r >= 0 && result.count < count; r = ranks.next(r))
+			result.add(mcs.order[r]);
 	}
+	result.stolen = stole && result.count > 0;
+	return result;
+}
 
-	// If we have enough free slots, we're done
-	if (static_cast<int>(result.slot_indices.size()) >= count)
-		return result;
+void VoiceAllocator::steal_oldest_group(MidiChannelState &mcs, int group_size)
+{
+	// Release whole note groups from the head of the LRU list (oldest
+	// first) until at least group_size voices were freed
+	int freed = 0;
+	while (freed < group_size && mcs.lru_head != kNone) {
+		uint8_t leader = static_cast<uint8_t>(mcs.lru_head);
+		freed += voices_[leader].group.count();
+		release_group(mcs, leader);
+	}
+}
 
-	// Not enough free slots — steal oldest note group
-	result.slot_indices.clear();
-	steal_oldest_group(mcs, count);
+// --- Note groups ---
 
-	// Try again after stealing
-	for (size_t i = 0; i < mcs.voices.size() && static_cast<int>(result.slot_indices.size()) < count; ++i) {
-		if (mcs.voices[i].note < 0)
-			result.slot_indices.push_back(static_cast<int>(i));
+void VoiceAllocator::start_group(MidiChannelState &mcs, uint8_t note, const VoiceMask &voices)
+{
+	uint8_t leader = static_cast<uint8_t>(voices.first());
+	for (int ch = leader; ch >= 0; ch = voices.next(ch)) {
+		voices_[ch].note = static_cast<int8_t>(note);
+		voices_[ch].leader = leader;
 	}
 
-	if (!result.slot_indices.empty())
-		result.stolen = true;
+	// Append to the LRU list as the newest group
+	auto &lv = voices_[leader];
+	lv.group = voices;
+	lv.prev = mcs.lru_tail;
+	lv.next = kNone;
+	if (mcs.lru_tail != kNone)
+		voices_[mcs.lru_tail].next = static_cast<int8_t>(leader);
+	else
+		mcs.lru_head = static_cast<int8_t>(leader);
+	mcs.lru_tail = static_cast<int8_t>(leader);
+
+	lv.seq = ++group_seq_;
+
+	mcs.sounding |= voices;
+	busy_ |= voices;
+	mcs.note_leader[note] = static_cast<int8_t>(leader);
+}
 
-	return result;
+void VoiceAllocator::release_group(MidiChannelState &mcs, uint8_t leader)
+{
+	VoiceMask group = voices_[leader].group;
+	mcs.note_leader[voices_[leader].note] = kNone;
+	lru_unlink(mcs, leader);
+	for (int ch = group.first(); ch >= 0; ch = group.next(ch)) {
+		release_channel(static_cast<uint8_t>(ch));
+		voices_[ch] = Voice{};
+	}
+	mcs.sounding &= ~group;
+	mcs.sustained &= ~group;
+	busy_ &= ~group;
 }
 
-void VoiceAllocator::steal_oldest_group(MidiChannelState &mcs, int group_size)
+void VoiceAllocator::release_voice(MidiChannelState &mcs, uint8_t ch)
 {
-	// Find the voice group with the lowest (oldest) timestamp
-	uint64_t oldest_ts = std::numeric_limits<uint64_t>::max();
-	int8_t oldest_note = -1;
-	uint64_t oldest_note_ts = 0;
+	uint8_t leader = voices_[ch].leader;
+	VoiceMask rest = voices_[leader].group;
+	rest.reset(ch);
+
+	if (rest.none()) {
+		mcs.note_leader[voices_[ch].note] = kNone;
+		lru_unlink(mcs, leader);
+	} else if (ch == leader) {
+		// Hand the group's LRU position over to its next-lowest voice
+		uint8_t nl = static_cast<uint8_t>(rest.first());
+		auto &old = voices_[ch];
+		auto &nv = voices_[nl];
+		nv.group = rest;
+		nv.seq = old.seq;
+		nv.prev = old.prev;
+		nv.next = old.next;
+		if (nv.prev != kNone)
+			voices_[nv.prev].next = static_cast<int8_t>(nl);
+		else
+			mcs.lru_head = static_cast<int8_t>(nl);
+		if (nv.next != kNone)
+			voices_[nv.next].prev = static_cast<int8_t>(nl);
+		else
+			mcs.lru_tail = static_cast<int8_t>(nl);
+		for (int m = rest.first(); m >= 0; m = rest.next(m))
+			voices_[m].leader = nl;
+		mcs.note_leader[nv.note] = static_cast<int8_t>(nl);
+	} else {
+		voices_[leader].group = rest;
+	}
 
-	for (auto &v : mcs.voices) {
-		if (v.note >= 0 && v.timestamp < oldest_ts) {
-			oldest_ts = v.timestamp;
-			oldest_note = v.note;
-			oldest_note_ts = v.timestamp;
-		}
+	release_channel(ch);
+	voices_[ch] = Voice{};
+	mcs.sounding.reset(ch);
+	mcs.sustained.reset(ch);
+	busy_.reset(ch);
+}
+
+void VoiceAllocator::release_all(MidiChannelState &mcs)
+{
+	for (int ch = mcs.sounding.first(); ch >= 0; ch = mcs.sounding.next(ch)) {
+		release_channel(static_cast<uint8_t>(ch));
+		voices_[ch] = Voice{};
 	}
+	busy_ &= ~mcs.sounding;
+	mcs.sounding.clear();
+	mcs.sustained.clear();
+	mcs.lru_head = mcs.lru_tail = kNone;
+	mcs.note_leader.fill(kNone);
+}
 
-	if (oldest_note < 0) return;
+void VoiceAllocator::lru_unlink(MidiChannelState &mcs, uint8_t leader)
+{
+	auto &v = voices_[leader];
+	if (v.prev != kNone)
+		voices_[v.prev].next = v.next;
+	else
+		mcs.lru_head = v.next;
+	if (v.next != kNone)
+		voices_[v.next].prev = v.prev;
+	else
+		mcs.lru_tail = v.prev;
+	v.prev = v.next = kNone;
+}
 
-	// Release all voices in this note group (same note + timestamp = unison group)
-	int freed = 0;
-	for (size_t i = 0; i < mcs.voices.size(); ++i) {
-		if (mcs.voices[i].note == oldest_note && mcs.voices[i].timestamp == oldest_note_ts) {
-			dm_.release_note_on_channel(mcs.config.opl3_channels[i]);
-			mcs.voices[i] = Voice{};
-			freed++;
+// --- Dynamic pool ---
+
+void VoiceAllocator::set_pool_mode(PoolMode mode)
+{
+	if (mode == pool_mode_) return;
+
+	for (auto &mcs : midi_channels_)
+		release_all(mcs);
+
+	pool_mode_ = mode;
+	if (mode == PoolMode::Dynamic)
+		enter_dynamic();
+	else
+		leave_dynamic();
+}
+
+void VoiceAllocator::set_channel_limits(uint8_t midi_ch, const ChannelLimits &limits)
+{
+	if (midi_ch >= 16) return;
+	midi_channels_[midi_ch].limits = limits;
+}
+
+const ChannelLimits &VoiceAllocator::channel_limits(uint8_t midi_ch) const
+{
+	return midi_channels_[midi_ch].limits;
+}
+
+VoiceMask VoiceAllocator::dynamic_pool() const
+{
+	VoiceMask pool;
+	for (int ch = 0; ch < channel_count(); ++ch)
+		pool.set(ch);
+	// Card 0 channels 6-8 play the drums in percussion mode
+	if (perc_mode_) {
+		for (int ch = 6; ch <= 8; ++ch)
+			pool.reset(ch);
+	}
+	return pool;
+}
+
+int VoiceAllocator::unmet_reservations(uint8_t except_midi_ch) const
+{
+	int unmet = 0;
+	for (int i = 0; i < 16; ++i) {
+		if (i == except_midi_ch) continue;
+		const auto &mcs = midi_channels_[i];
+		unmet += std::max(0, mcs.limits.min_voices - mcs.sounding.count());
+	}
+	return unmet;
+}
+
+VoiceAllocator::AllocResult VoiceAllocator::allocate_dynamic(uint8_t midi_ch, int count)
+{
+	AllocResult result;
+	auto &mcs = midi_channels_[midi_ch];
+	VoiceMask pool = dynamic_pool();
+
+	// Stay under the channel's cap by stealing from itself
+	if (mcs.limits.max_voices) {
+		count = std::min<int>(count, mcs.limits.max_voices);
+		while (mcs.sounding.count() + count > mcs.limits.max_voices && mcs.lru_head != kNone) {
+			release_group(mcs, static_cast<uint8_t>(mcs.lru_head));
+			result.stolen = true;
 		}
 	}
 
-	// If we didn't free enough, steal another group
-	if (freed < group_size) {
-		steal_oldest_group(mcs, group_size - freed);
+	// Free voices not held back for other channels' reservations
+	int usable;
+	for (;;) {
+		usable = (pool & ~busy_).count() - unmet_reservations(midi_ch);
+		if (usable >= count || !steal_for(midi_ch))
+			break;
+		result.stolen = true;
 	}
+	count = std::min(count, usable);
+	if (count <= 0)
+		return result;
+
+	// Prefer channels that still carry our patch
+	VoiceMask free = pool & ~busy_;
+	VoiceMask voices = (free & mcs.patched).lowest(count);
+	voices |= (free & ~mcs.patched).lowest(count - voices.count());
+	for (int ch = voices.first(); ch >= 0; ch = voices.next(ch))
+		result.add(ch);
+	return result;
 }
 
-// --- Unison detuning ---
+bool VoiceAllocator::steal_for(uint8_t midi_ch)
+{
+	// Oldest group of the lowest-priority channel that may lose one
+	int requester = midi_channels_[midi_ch].limits.priority;
+	int victim = -1;
+	for (int i = 0; i < 16; ++i) {
+		const auto &mcs = midi_channels_[i];
+		if (mcs.lru_head == kNone) continue;
+		const Voice &oldest = voices_[mcs.lru_head];
+		if (i != midi_ch) {
+			if (mcs.limits.priority > requester) continue;
+			if (mcs.sounding.count() - oldest.group.count() < mcs.limits.min_voices) continue;
+		}
+		if (victim >= 0) {
+			const auto &best = midi_channels_[victim];
+			if (mcs.limits.priority > best.limits.priority) continue;
+			if (mcs.limits.priority == best.limits.priority &&
+			    oldest.seq > voices_[best.lru_head].seq) continue;
+		}
+		victim = i;
+	}
+	if (victim < 0)
+		return false;
+
+	auto &mcs = midi_channels_[victim];
+	release_group(mcs, static_cast<uint8_t>(mcs.lru_head));
+	return true;
+}
 
-void VoiceAllocator::compute_detuned_freq(uint8_t note, int voice_idx, int unison_count,
-                                            uint8_t detune_cents, uint16_t &f_num, uint8_t &block)
+// Patch register addresses of a 2-op channel (card-local index 0-17).
+static void patch_addrs(uint8_t local_ch, uint16_t *addrs)
 {
-	double cents_offset = 0;
-	if (unison_count > 1) {
-		cents_offset = (voice_idx - (unison_count - 1) / 2.0) * detune_cents / (unison_count - 1);
+	static constexpr uint8_t kOpRegs[5] = {
+		kRegAMVibEGKSMult, kRegKSLTL, kRegAR_DR, kRegSL_RR, kRegWaveform,
+	};
+	const auto &map = kChannelToOPL3[local_ch];
+	int n = 0;
+	for (int op = 0; op < 2; ++op) {
+		for (uint8_t reg : kOpRegs)
+			addrs[n++] = map.port_base | (reg + kOperatorOffset[map.opl_ch][op]);
 	}
+	addrs[n] = map.port_base | (kRegFeedbackConn + map.opl_ch);
+}
 
-	double freq = 440.0 * std::pow(2.0, (note - 69.0 + cents_offset / 100.0) / 12.0);
+void VoiceAllocator::take_patch(uint8_t ch, uint8_t midi_ch)
+{
+	auto &mcs = midi_channels_[midi_ch];
 
-	static constexpr double kOPL3FreqBase = 49716.0;
-	f_num = 0;
-	block = 0;
+	int8_t prev = patch_owner_[ch];
+	if (prev != kNone)
+		midi_channels_[prev].patched.reset(ch);
+	patch_owner_[ch] = static_cast<int8_t>(midi_ch);
+	mcs.patched.set(ch);
+
+	uint16_t addrs[kPatchRegs];
+	patch_addrs(card_channel(ch), addrs);
+	OPL3State &state = card(ch).state();
+	OPL3State::Batch batch(state);
+	for (int i = 0; i < kPatchRegs; ++i)
+		state.write(addrs[i], mcs.patch[i]);
+
+	// Levels and pan come from the channel's controllers, not the patch
+	cc_channel(ch, 7, mcs.volume);
+	cc_channel(ch, 11, mcs.expression);
+	cc_channel(ch, 10, mcs.pan);
+	cc_channel(ch, 1, mcs.mod_wheel);
+	cc_channel(ch, 74, mcs.brightness);
+}
 
-	for (int b = 0; b < 8; ++b) {
-		double divisor = kOPL3FreqBase / static_cast<double>(1 << (20 - b));
-		int fn = static_cast<int>(freq / divisor + 0.5);
-		if (fn <= 1023) {
-			if (fn < 0) fn = 0;
-			f_num = static_cast<uint16_t>(fn);
-			block = static_cast<uint8_t>(b);
-			return;
-		}
+void VoiceAllocator::save_patch(uint8_t midi_ch, uint8_t ch)
+{
+	uint16_t addrs[kPatchRegs];
+	patch_addrs(card_channel(ch), addrs);
+	OPL3State &state = card(ch).state();
+	auto &patch = midi_channels_[midi_ch].patch;
+	for (int i = 0; i < kPatchRegs; ++i)
+		patch[i] = state.read(addrs[i]);
+}
+
+void VoiceAllocator::enter_dynamic()
+{
+	// Each MIDI channel's patch is whatever its static pool holds now
+	patch_owner_.fill(kNone);
+	for (int i = 0; i < 16; ++i) {
+		auto &mcs = midi_channels_[i];
+		mcs.patched = mcs.pool;
+		for (int ch = mcs.pool.first(); ch >= 0; ch = mcs.pool.next(ch))
+			patch_owner_[ch] = static_cast<int8_t>(i);
+		int src = mcs.pool.any() ? mcs.pool.first() : i;
+		save_patch(static_cast<uint8_t>(i), static_cast<uint8_t>(src));
+	}
+}
+
+void VoiceAllocator::leave_dynamic()
+{
+	// Put every MIDI channel's patch back on its static pool
+	for (int i = 0; i < 16; ++i) {
+		auto &mcs = midi_channels_[i];
+		for (int ch = mcs.pool.first(); ch >= 0; ch = mcs.pool.next(ch))
+			take_patch(static_cast<uint8_t>(ch), static_cast<uint8_t>(i));
 	}
+	patch_owner_.fill(kNone);
+	for (auto &mcs : midi_channels_)
+		mcs.patched.clear();
+}
+
+// --- Unison detuning ---
 
-	f_num = 1023;
-	block = 7;
+int16_t VoiceAllocator::detune_pitch(int voice_idx, int unison_count, uint8_t detune_cents)
+{
+	if (unison_count <= 1)
+		return 0;
+
+	// Symmetric spread: (voice_idx - (N-1)/2) * detune_cents / (N-1) cents
+	double cents_offset = (voice_idx - (unison_count - 1) / 2.0) * detune_cents / (unison_count - 1);
+	return static_cast<int16_t>(cents_pitch(cents_offset));
 }
 
 // --- Percussion routing ---
@@ -780,4 +1068,44 @@ void VoiceAllocator::sysex_perc_query()
 	midi_output_(msg);
 }
 
+void VoiceAllocator::sysex_pool_config(const uint8_t *data, size_t len)
+{
+	// Format: [mode] then optionally 16 x [min] [max] [priority]
+	// mode: 0 = static, 1 = dynamic
+	if (len < 1) return;
+
+	if (len >= 1 + 16 * 3) {
+		for (uint8_t ch = 0; ch < 16; ++ch) {
+			ChannelLimits limits;
+			limits.min_voices = data[1 + ch * 3];
+			limits.max_voices = data[2 + ch * 3];
+			limits.priority = data[3 + ch * 3];
+			set_channel_limits(ch, limits);
+		}
+	}
+
+	set_pool_mode(data[0] ? PoolMode::Dynamic : PoolMode::Static);
+}
+
+void VoiceAllocator::sysex_pool_query()
+{
+	if (!midi_output_) return;
+
+	// Response uses PoolConfig format so it's re-sendable
+	std::vector<uint8_t> msg;
+	msg.push_back(0xF0);
+	msg.push_back(kSysExManufID);
+	msg.push_back(device_id_);
+	msg.push_back(kSysExPoolConfig);
+	msg.push_back(pool_mode_ == PoolMode::Dynamic ? 0x01 : 0x00);
+	for (const auto &mcs : midi_channels_) {
+		msg.push_back(mcs.limits.min_voices);
+		msg.push_back(mcs.limits.max_voices);
+		msg.push_back(mcs.limits.priority);
+	}
+	msg.push_back(0xF7);
+
+	midi_output_(msg);
+}
+
 } // namespace retrowave
@@ -21,38 +21,6 @@
 #include "mainwindow.h"
 #include "./ui_mainwindow.h"
 
-class RetroWaveOPL3 final : public OPLChipBaseT<RetroWaveOPL3> {
-public:
-	MainWindow *mw_;
-
-public:
-	RetroWaveOPL3(MainWindow *mw) : mw_(mw) {
-		auto &hw = mw_->hw_buf();
-		hw.reset();
-
-		writeReg(0x004, 96);
-		writeReg(0x004, 128);
-		writeReg(0x105, 0x0);
-		writeReg(0x105, 0x1);
-		writeReg(0x105, 0x0);
-		writeReg(0x001, 32);
-		writeReg(0x105, 0x1);
-
-	}
-
-	bool canRunAtPcmRate() const override { return true; }
-
-	void writeReg(uint16_t addr, uint8_t data) override {
-		mw_->hw_buf().queue(addr, data);
-	};
-
-	void nativePreGenerate() override {}
-	void nativePostGenerate() override {}
-	void nativeGenerate(int16_t *frame) override {};
-	const char *emulatorName() override { return "RetroWave"; };
-	ChipType chipType() override {return CHIPTYPE_OPL3;};
-};
-
 MainWindow::MainWindow(QWidget *parent)
 	: QMainWindow(parent)
 	, ui(new Ui::MainWindow)
@@ -281,20 +249,12 @@ bool MainWindow::start() {
 	auto *synth = real_midiplay->m_synth.get();
 	auto &chips = synth->m_chips;
 	assert(chips.size() == 1);
-	auto *vgmopl3 = new RetroWaveOPL3(this);
-	chips[0].reset(vgmopl3);
-
-	adl_midi_sequencer = real_midiplay->m_sequencer.get();
+	chips[0].reset(new retrowave::RetroWaveADLChip(opl3_state_));
 
 	synth->updateChannelCategories();
 	synth->silenceAll();
 
-
-	for (unsigned i=0; i<16; i++) {
-		adl_midi_sequencer->setChannelEnabled(i, true);
-	}
-
-	adl_midi_sequencer->m_trackDisable.resize(16);
+	adl_last_tick_ns = retrowave::monotonic_ns();
 
 	tmr_adl = new QTimer(this);
 	tmr_adl->setTimerType(Qt::PreciseTimer);
@@ -313,7 +273,8 @@ void MainWindow::stop() {
 	delete tmr_adl;
 	tmr_adl = nullptr;
 
-	adl_midi_sequencer = nullptr;
+	// Drop anything received after the last timer tick
+	midi_queue_.clear();
 
 	if (adl_midi_player) {
 		adl_close(adl_midi_player);
@@ -347,23 +308,17 @@ void MainWindow::midi_init() {
 
 void MainWindow::midi_on_receive(double timeStamp, std::vector<unsigned char> *message, void *userData) {
 	auto *ctx = (MainWindow *)userData;
-	std::lock_guard<std::mutex> lg(ctx->hw_buf().mutex());
+	ctx->midi_queue_.push(message->data(), message->size());
+}
 
+void MainWindow::process_message(const uint8_t *data, size_t len) {
 	// Try direct mode first
-	if (ctx->midi_router_.process(message->data(), message->size()))
+	if (midi_router_.process(data, len))
 		return;
 
-	// Bank mode: forward to libADLMIDI sequencer
-	auto *ams = ctx->adl_midi_sequencer;
-	if (!ams) return;
-
-	const uint8_t *pp = message->data();
-	int s = 0;
-
-	auto evt = ams->parseEvent(&pp, pp + message->size(), s);
-	int32_t s2 = 0;
-
-	ams->handleEvent(0, evt, s2);
+	// Bank mode: forward to libADLMIDI's real-time API
+	if (adl_midi_player)
+		retrowave::adl_rt_dispatch(adl_midi_player, data, len);
 }
 
 void MainWindow::midi_on_error(RtMidiError::Type type, const std::string &errorText, void *userData) {
@@ -371,11 +326,21 @@ void MainWindow::midi_on_error(RtMidiError::Type type, const std::string &errorT
 }
 
 void MainWindow::a_adl_timer_timeout() {
-	std::lock_guard<std::mutex> lg(hw_buf_.mutex());
+	midi_queue_.drain([this](const uint8_t *data, size_t len, int64_t) {
+		process_message(data, len);
+	});
 
 	if (midi_router_.mode() == retrowave::RoutingMode::Bank && adl_midi_player) {
-		int16_t discard[8];
-		adl_generate(adl_midi_player, 2, discard);
+		// Advance by the real elapsed time; no PCM is rendered. A stalled
+		// event loop must not skip envelopes and LFOs ahead by seconds.
+		static constexpr int64_t kMaxStepNs = 1000000000; // 1s
+		int64_t now = retrowave::monotonic_ns();
+		int64_t elapsed = now - adl_last_tick_ns;
+		adl_last_tick_ns = now;
+		if (elapsed > kMaxStepNs)
+			elapsed = kMaxStepNs;
+		if (elapsed > 0)
+			adl_tickIterators(adl_midi_player, elapsed / 1e9);
 	}
 
 	hw_buf_.flush();
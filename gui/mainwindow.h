@@ -19,8 +19,6 @@
 
 #pragma once
 
-#include <mutex>
-
 #include <QMainWindow>
 
 #include <QFile>
@@ -36,13 +34,15 @@
 #include <adlmidi.h>
 #include <adlmidi_midiplay.hpp>
 #include <adlmidi_opl3.hpp>
-#include <chips/opl_chip_base.h>
-#include <midi_sequencer.hpp>
 
 #include <retrowave/opl3_hw.h>
 #include <retrowave/opl3_state.h>
 #include <retrowave/direct_mode.h>
 #include <retrowave/midi_router.h>
+#include <retrowave/midi_queue.h>
+#include <retrowave/midi_clock.h>
+#include <retrowave/adl_realtime.h>
+#include <retrowave/adl_chip.h>
 #include "serial_qt.h"
 
 QT_BEGIN_NAMESPACE
@@ -65,9 +65,6 @@ public:
 	void stop();
 	void midi_init();
 
-	// OPL3 hardware buffer access (used by RetroWaveOPL3 chip class)
-	retrowave::OPL3HardwareBuffer &hw_buf() { return hw_buf_; }
-
 	static void midi_on_receive(double timeStamp, std::vector<unsigned char> *message, void *userData);
 	static void midi_on_error(RtMidiError::Type type, const std::string &errorText, void *userData);
 private slots:
@@ -98,6 +95,11 @@ private:
 	retrowave::DirectMode direct_mode_{opl3_state_};
 	retrowave::MidiRouter midi_router_;
 
+	// rtmidi callback -> Qt main thread (drained by a_adl_timer_timeout)
+	retrowave::MidiQueue midi_queue_;
+
+	void process_message(const uint8_t *data, size_t len);
+
 	int bank_id = 58;
 	QString bank_path, bank_last_dir;
 	int volmodel_id = 0;
@@ -107,7 +109,7 @@ private:
 	int midi_port = -1;
 
 	ADL_MIDIPlayer *adl_midi_player = nullptr;
-	MidiSequencer *adl_midi_sequencer = nullptr;
 	QTimer *tmr_adl = nullptr;
+	int64_t adl_last_tick_ns = 0;
 	bool started = false;
 };
@@ -434,12 +434,7 @@ QWidget *PanelWindow::build_midi_channel_tab(int midi_ch)
 	connect(panSplitCb, &QCheckBox::toggled, this, [this, midi_ch](bool on) {
 		retrowave::VoiceConfig config = voice_alloc_.voice_config(static_cast<uint8_t>(midi_ch));
 		config.pan_split = on;
-		if (running_) {
-			std::lock_guard<std::mutex> lg(hw_buf_.mutex());
-			voice_alloc_.set_voice_config(static_cast<uint8_t>(midi_ch), config);
-		} else {
-			voice_alloc_.set_voice_config(static_cast<uint8_t>(midi_ch), config);
-		}
+		voice_alloc_.set_voice_config(static_cast<uint8_t>(midi_ch), config);
 	});
 
 	uniRow->addSpacing(12);
@@ -908,14 +903,11 @@ void PanelWindow::apply_voice_config(int midi_ch)
 	auto assigned = collect_checked(tab);
 
 	retrowave::VoiceConfig config = voice_alloc_.voice_config(static_cast<uint8_t>(midi_ch));
-	config.opl3_channels = assigned;
+	config.opl3_channels.clear();
+	for (uint8_t ch : assigned)
+		config.opl3_channels.push_back(ch);
 	config.four_op = tab.four_op_cb && tab.four_op_cb->isChecked();
-	if (running_) {
-		std::lock_guard<std::mutex> lg(hw_buf_.mutex());
-		voice_alloc_.set_voice_config(static_cast<uint8_t>(midi_ch), config);
-	} else {
-		voice_alloc_.set_voice_config(static_cast<uint8_t>(midi_ch), config);
-	}
+	voice_alloc_.set_voice_config(static_cast<uint8_t>(midi_ch), config);
 
 	// Update unison max and poly label
 	int pool = voice_alloc_.poly_voice_count(static_cast<uint8_t>(midi_ch));
@@ -997,12 +989,7 @@ void PanelWindow::on_unison_changed(int midi_ch, int unison)
 {
 	retrowave::VoiceConfig config = voice_alloc_.voice_config(static_cast<uint8_t>(midi_ch));
 	config.unison_count = static_cast<uint8_t>(unison);
-	if (running_) {
-		std::lock_guard<std::mutex> lg(hw_buf_.mutex());
-		voice_alloc_.set_voice_config(static_cast<uint8_t>(midi_ch), config);
-	} else {
-		voice_alloc_.set_voice_config(static_cast<uint8_t>(midi_ch), config);
-	}
+	voice_alloc_.set_voice_config(static_cast<uint8_t>(midi_ch), config);
 	update_poly_label(midi_ch);
 }
 
@@ -1010,12 +997,7 @@ void PanelWindow::on_detune_changed(int midi_ch, int cents)
 {
 	retrowave::VoiceConfig config = voice_alloc_.voice_config(static_cast<uint8_t>(midi_ch));
 	config.detune_cents = static_cast<uint8_t>(cents);
-	if (running_) {
-		std::lock_guard<std::mutex> lg(hw_buf_.mutex());
-		voice_alloc_.set_voice_config(static_cast<uint8_t>(midi_ch), config);
-	} else {
-		voice_alloc_.set_voice_config(static_cast<uint8_t>(midi_ch), config);
-	}
+	voice_alloc_.set_voice_config(static_cast<uint8_t>(midi_ch), config);
 }
 
 void PanelWindow::update_poly_label(int midi_ch)
@@ -1034,12 +1016,7 @@ void PanelWindow::update_poly_label(int midi_ch)
 
 void PanelWindow::on_perc_mode_toggled(bool enabled)
 {
-	if (running_) {
-		std::lock_guard<std::mutex> lg(hw_buf_.mutex());
-		voice_alloc_.set_percussion_mode(enabled);
-	} else {
-		voice_alloc_.set_percussion_mode(enabled);
-	}
+	voice_alloc_.set_percussion_mode(enabled);
 
 	perc_group_->setVisible(enabled);
 
@@ -1067,12 +1044,7 @@ void PanelWindow::on_perc_mode_toggled(bool enabled)
 void PanelWindow::on_drum_routing_changed(int drum_idx, int midi_ch)
 {
 	auto drum = static_cast<retrowave::DirectMode::Drum>(drum_idx);
-	if (running_) {
-		std::lock_guard<std::mutex> lg(hw_buf_.mutex());
-		voice_alloc_.set_drum_midi_channel(drum, midi_ch);
-	} else {
-		voice_alloc_.set_drum_midi_channel(drum, midi_ch);
-	}
+	voice_alloc_.set_drum_midi_channel(drum, midi_ch);
 }
 
 // --- Port refresh ---
@@ -1167,6 +1139,7 @@ void PanelWindow::on_start_stop_clicked()
 		flush_timer_->stop();
 		delete flush_timer_;
 		flush_timer_ = nullptr;
+		midi_queue_.clear();
 
 		serial_.close();
 
@@ -1183,15 +1156,18 @@ void PanelWindow::on_start_stop_clicked()
 void PanelWindow::midi_callback(double /*ts*/, std::vector<unsigned char> *msg, void *user)
 {
 	auto *self = static_cast<PanelWindow *>(user);
-	std::lock_guard<std::mutex> lg(self->hw_buf_.mutex());
-	self->voice_alloc_.process_midi(msg->data(), msg->size());
+	self->midi_queue_.push(msg->data(), msg->size());
 }
 
 // --- Flush timer (Qt main thread) ---
 
+// The main thread is the engine thread: UI handlers and queued MIDI both
+// drive the voice allocator from here, so no locking is needed.
 void PanelWindow::on_flush_timer()
 {
-	std::lock_guard<std::mutex> lg(hw_buf_.mutex());
+	midi_queue_.drain([this](const uint8_t *data, size_t len, int64_t) {
+		voice_alloc_.process_midi(data, len);
+	});
 	hw_buf_.flush();
 }
 
@@ -1201,8 +1177,6 @@ void PanelWindow::send_nrpn_to_midi_ch(uint8_t midi_ch, uint8_t msb, uint8_t lsb
 {
 	if (!running_) return;
 
-	std::lock_guard<std::mutex> lg(hw_buf_.mutex());
-
 	// Global NRPNs (MSB 5) only need to go to one OPL3 channel
 	if (msb == 5) {
 		direct_mode_.direct_nrpn(0, msb, lsb, value);
@@ -1470,7 +1444,9 @@ void PanelWindow::apply_instrument(int midi_ch, const WOPLInstrument &inst)
 	if (tab.alg_combo)     tab.alg_combo->blockSignals(false);
 
 	// Explicitly send all NRPNs to hardware (unconditional — every parameter is sent
-	// regardless of whether the widget value changed, ensuring a complete patch load)
+	// regardless of whether the widget value changed, ensuring a complete patch load).
+	// The batch keeps the whole patch in one frame.
+	retrowave::OPL3State::Batch batch(opl3_state_);
 	for (int wopl_idx = 0; wopl_idx < num_ops; ++wopl_idx) {
 		int pi = wopl_to_panel[wopl_idx];
 		auto msb = static_cast<uint8_t>(pi);
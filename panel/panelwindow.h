@@ -36,6 +36,7 @@
 #include <retrowave/opl3_state.h>
 #include <retrowave/direct_mode.h>
 #include <retrowave/voice_allocator.h>
+#include <retrowave/midi_queue.h>
 #include "fm_diagram_widget.h"
 #include "serial_qt.h"
 
@@ -103,6 +104,7 @@ private:
 
 	// MIDI
 	RtMidiIn *midiin_ = nullptr;
+	retrowave::MidiQueue midi_queue_; // rtmidi thread -> on_flush_timer()
 	bool running_ = false;
 	QTimer *flush_timer_ = nullptr;
 